@@ -0,0 +1,137 @@
+// compares the shared lock-free injection queue that thread_pool uses for tasks submitted
+// from outside the pool (mpmc_queue) against what it replaced: spreading those tasks
+// round-robin over the workers' mutex-guarded work_stealing_queues, with each consumer
+// popping its own queue and then stealing from the others. Sweeps 1 to N producers
+// against 1 to N consumers (N defaults to the number of cores, and at least 4), each
+// producer pushing TASKS_PER_PRODUCER small tasks which the consumers run. Prints the
+// time (in ms) to get through all of them.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <string>
+
+#include "../libs/multi-threading/function-wrapper.h"
+#include "../libs/multi-threading/mpmc-queue.h"
+#include "../libs/multi-threading/work-stealing-queue.h"
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int TASKS_PER_PRODUCER = 250000;
+constexpr std::size_t INJECTION_CAPACITY = 4096;
+
+// starts numProducers threads running produce(index) and numConsumers threads running
+// consume(index), and times how long it takes until they've all finished:
+template <typename Produce, typename Consume>
+double timeRun(int numProducers, int numConsumers, Produce produce, Consume consume) {
+
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < numProducers; i++) {
+        threads.emplace_back([&, i]() {
+            while (!go) { std::this_thread::yield(); }
+            produce(i);
+        });
+    }
+    for (int i = 0; i < numConsumers; i++) {
+        threads.emplace_back([&, i]() {
+            while (!go) { std::this_thread::yield(); }
+            consume(i);
+        });
+    }
+
+    Clock::time_point start = Clock::now();
+    go = true;
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+}
+
+double mpmc(int numProducers, int numConsumers) {
+
+    mpmc_queue<function_wrapper> queue(INJECTION_CAPACITY);
+    std::atomic<int> remaining(numProducers * TASKS_PER_PRODUCER);
+
+    return timeRun(numProducers, numConsumers,
+        [&](int) {
+            for (int i = 0; i < TASKS_PER_PRODUCER; i++) {
+                function_wrapper task([&remaining]() { remaining--; });
+                // NB: the pool runs a task itself when the queue's full; here there's
+                // nothing to run, so it just waits for room:
+                while (!queue.try_push(task)) {
+                    std::this_thread::yield();
+                }
+            }
+        },
+        [&](int) {
+            function_wrapper task;
+            while (remaining.load(std::memory_order_relaxed) > 0) {
+                if (queue.try_pop(task)) {
+                    task();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+}
+
+double mutexDeques(int numProducers, int numConsumers) {
+
+    std::vector<std::unique_ptr<work_stealing_queue<function_wrapper>>> queues;
+    for (int i = 0; i < numConsumers; i++) {
+        queues.push_back(std::make_unique<work_stealing_queue<function_wrapper>>());
+    }
+    std::atomic<unsigned int> nextQueue(0);
+    std::atomic<int> remaining(numProducers * TASKS_PER_PRODUCER);
+
+    return timeRun(numProducers, numConsumers,
+        [&](int) {
+            for (int i = 0; i < TASKS_PER_PRODUCER; i++) {
+                unsigned int index = nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+                queues[index]->push(function_wrapper([&remaining]() { remaining--; }));
+            }
+        },
+        [&](int index) {
+            function_wrapper task;
+            while (remaining.load(std::memory_order_relaxed) > 0) {
+                bool found = queues[index]->try_pop(task);
+                for (int i = 1, l = queues.size(); !found && i < l; i++) {
+                    found = queues[(index + i) % l]->try_steal(task);
+                }
+                if (found) {
+                    task();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+}
+
+int main(int argc, char* argv[]) {
+
+    int maxThreads = argc > 1 ? std::stoi(argv[1]) : std::max(4, (int)std::thread::hardware_concurrency());
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "producers  consumers  mpmc (ms)  mutex deques (ms)" << std::endl;
+
+    for (int numProducers = 1; numProducers <= maxThreads; numProducers++) {
+        for (int numConsumers = 1; numConsumers <= maxThreads; numConsumers++) {
+            std::cout << std::setw(9) << numProducers
+                      << std::setw(11) << numConsumers
+                      << std::setw(11) << mpmc(numProducers, numConsumers)
+                      << std::setw(19) << mutexDeques(numProducers, numConsumers) << std::endl;
+        }
+    }
+
+}
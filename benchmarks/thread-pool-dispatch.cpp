@@ -0,0 +1,113 @@
+// measures how quickly a thread_pool gets tasks going: the latency from submitting a
+// single task (from outside the pool) to it starting, and the time taken to get through
+// a lot of tiny tasks, either submitted from outside the pool or spawned by its workers.
+// Run with the number of workers to try (default: 1 and the number of cores).
+//
+// NB: only uses thread_pool(num_threads) and submit, so it builds against older versions
+// of the pool too (e.g. from a git worktree), for comparing before and after a change
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <string>
+#include <functional>
+
+#include "../libs/multi-threading/thread-pool.h"
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int NUM_LATENCY_SAMPLES = 10000;
+constexpr int NUM_TASKS = 1000000;
+constexpr int NUM_SPAWNERS = 1000;
+
+double millisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void waitFor(std::atomic<int> &remaining) {
+    while (remaining.load() > 0) {
+        std::this_thread::yield();
+    }
+}
+
+// median time (in microseconds) from submit to the task starting, one task at a time:
+double latency(thread_pool &pool) {
+
+    std::vector<double> samples;
+    samples.reserve(NUM_LATENCY_SAMPLES);
+
+    for (int i = 0; i < NUM_LATENCY_SAMPLES; i++) {
+        std::atomic<int> remaining(1);
+        Clock::time_point started;
+        Clock::time_point submitted = Clock::now();
+        pool.submit([&remaining, &started]() {
+            started = Clock::now();
+            remaining--;
+        });
+        waitFor(remaining);
+        samples.push_back(std::chrono::duration<double, std::micro>(started - submitted).count());
+    }
+
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    return samples[samples.size() / 2];
+
+}
+
+double submittedFromOutside(thread_pool &pool) {
+
+    std::atomic<int> remaining(NUM_TASKS);
+    Clock::time_point start = Clock::now();
+
+    for (int i = 0; i < NUM_TASKS; i++) {
+        pool.submit([&remaining]() { remaining--; });
+    }
+    waitFor(remaining);
+
+    return millisecondsSince(start);
+
+}
+
+double spawnedByWorkers(thread_pool &pool) {
+
+    std::atomic<int> remaining(NUM_TASKS);
+    Clock::time_point start = Clock::now();
+
+    for (int i = 0; i < NUM_SPAWNERS; i++) {
+        pool.submit([&pool, &remaining]() {
+            for (int j = 0; j < NUM_TASKS / NUM_SPAWNERS; j++) {
+                pool.submit([&remaining]() { remaining--; });
+            }
+        });
+    }
+    waitFor(remaining);
+
+    return millisecondsSince(start);
+
+}
+
+int main(int argc, char* argv[]) {
+
+    std::vector<int> workerCounts;
+    for (int i = 1; i < argc; i++) {
+        workerCounts.push_back(std::stoi(argv[i]));
+    }
+    if (workerCounts.empty()) {
+        workerCounts = { 1, std::max(2, (int)std::thread::hardware_concurrency()) };
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "workers  p50 latency (us)  1M from outside (ms)  1M spawned (ms)" << std::endl;
+
+    for (int numWorkers : workerCounts) {
+        thread_pool pool(numWorkers);
+        std::cout << std::setw(7) << numWorkers
+                  << std::setw(19) << latency(pool)
+                  << std::setw(22) << submittedFromOutside(pool)
+                  << std::setw(17) << spawnedByWorkers(pool) << std::endl;
+    }
+
+}
@@ -20,6 +20,8 @@ struct Block {
     static constexpr int ROCK = 3;
     static constexpr int SAND = 4;
     static constexpr int WATER = 5;
+    static constexpr int WOOD = 6;
+    static constexpr int LEAVES = 7;
 
     static constexpr Properties properties[] = {
         { false, false, -1, -1, -1, -1, -1, -1 },
@@ -27,7 +29,9 @@ struct Block {
         { true, true, 43, 43, 43, 43, 43, 43 },
         { true, true, 0, 0, 0, 0, 0, 0 },
         { true, true, 40, 40, 40, 40, 40, 40 },
-        { true, true, 356, 356, 356, 356, 356, 356 }
+        { true, true, 356, 356, 356, 356, 356, 356 },
+        { true, true, 92, 92, 92, 92, 93, 93 },
+        { true, true, 160, 160, 160, 160, 160, 160 }
     };
 
     int type;
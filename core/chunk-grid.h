@@ -0,0 +1,532 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "../libs/multi-threading/coroutines.h"
+#include "../libs/aabb.h"
+#include "../libs/gl-queue.h"
+#include "../libs/vertex-arena.h"
+#include "./executors.h"
+#include "./chunk.h"
+#include "./world-gen.h"
+
+// in order to use std::unordered_map with std::pair as a key, we need to
+// create our own hash function
+// https://stackoverflow.com/a/20602159/1937302
+// https://stackoverflow.com/a/27952689/1937302
+struct hashPair {
+    template <typename T, typename U>
+    std::size_t operator()(const std::pair<T, U> &x) const {
+        std::size_t lhs = std::hash<T>()(x.first);
+        std::size_t rhs = std::hash<U>()(x.second);
+        lhs ^= rhs + 0x9e3779b97f4a7c15 + (lhs << 6) + (lhs >> 2);
+        return lhs;
+    }
+};
+
+// ChunkGrid manages the square of chunks (all of the same voxel size) around the player.
+// Each chunk's whole lifecycle is a single coroutine (see buildChunk):
+//   generate -> wait to be wanted -> wait for neighbours' blocks -> count faces
+//   -> map a staging buffer -> write the mesh into it -> unmap and copy into the arena
+// Generation and meshing run on their own executors, and uploads on the main thread
+// (via glQueue). Waiting never blocks a thread - the coroutine
+// is parked and picked back up by whoever finishes whatever it was waiting for. So
+// meshing of one area overlaps with generation of another.
+//
+// chunks will be created and their blocks generated when they are
+// within createRadius. They will have their meshes generated when
+// they are within drawRadius; and they will be freed when they are
+// outside outerRadius:
+// NB: radius is a bit of a misnomer as currently we're considering
+// these boundaries to be square:
+//
+// chunks are also grouped into square regions of REGION_SIZE x REGION_SIZE chunks (kept
+// up to date as chunks come and go), so that the renderer can cull whole areas at once.
+//
+// chunks get skirts (see Chunk::setSkirts) along the lines every skirtSpacing chunks,
+// i.e. wherever they might meet chunks at another level of detail:
+class ChunkGrid {
+
+public:
+
+    using Generator = WorldGen<Chunk::CHUNK_SIZE_X, Chunk::CHUNK_SIZE_Y, Chunk::CHUNK_SIZE_Z>;
+
+    static constexpr int REGION_SIZE = 8;
+
+    struct RegionChunk {
+        int i, j;
+        Chunk* chunk;
+    };
+
+    struct Region {
+        // the bounds of the whole region (whether or not all its chunks are loaded):
+        AABB bounds;
+        std::vector<RegionChunk> chunks;
+    };
+
+    ChunkGrid(int voxelSize, int drawRadius, int skirtSpacing, const Generator &worldGen, Executors &executors, GLQueue &glQueue, VertexArena &vertexArena)
+        : voxelSize(voxelSize), drawRadius(drawRadius), createRadius(drawRadius + 1), outerRadius(drawRadius + 2), skirtSpacing(skirtSpacing),
+            worldGen(worldGen), executors(executors), glQueue(glQueue), vertexArena(vertexArena), tasksInFlight(0) {}
+
+    ~ChunkGrid() {
+
+        // coroutines refer to entries (and each other's entries), so wait for the
+        // running ones to get as far as they can, then cancel everything:
+        waitUntilIdle();
+
+        for (auto const& [key, entry] : entries) {
+            releaseEntry(entry);
+        }
+        entries.clear();
+        regions.clear();
+
+        // and let the cancelled coroutines clean up after themselves:
+        waitUntilIdle();
+
+    }
+
+    // NB: must be called from the main thread. uploads happen as and when glQueue is run
+    void update(const glm::vec3 &position) {
+
+        freeChunks(position);
+        scheduleChunks(position);
+
+    }
+
+    // keeps running tasks and uploading meshes until every chunk is either done, or
+    // waiting to be wanted:
+    // NB: must be called from the main thread
+    void waitUntilIdle() {
+
+        while (tasksInFlight > 0) {
+
+            if (glQueue.runAll()) { continue; }
+
+            // meshing first, as that's what gets chunks on screen:
+            if (!executors.meshing.run_pending_task() && !executors.generation.run_pending_task()) {
+                std::this_thread::yield();
+            }
+
+        }
+
+    }
+
+    Chunk* getChunk(int i, int j) const {
+
+        auto search = entries.find(std::make_pair(i, j));
+        if (search == entries.end()) {
+            return nullptr;
+        }
+        return search->second->chunk;
+
+    }
+
+    // calls f(i, j, chunk) for every chunk in the grid:
+    template <typename F>
+    void forEachChunk(F&& f) const {
+
+        for (auto const& [key, entry] : entries) {
+            f(key.first, key.second, entry->chunk);
+        }
+
+    }
+
+    // calls f(region) for every region that has chunks in it:
+    // NB: only valid until the next call to update
+    template <typename F>
+    void forEachRegion(F&& f) const {
+
+        for (auto const& [key, region] : regions) {
+            f(region);
+        }
+
+    }
+
+    int getVoxelSize() const { return voxelSize; }
+
+    // changes whenever chunks are added or removed (so anything built from the set of
+    // chunks knows when it needs redoing):
+    unsigned int getVersion() const { return version; }
+
+    ChunkGrid(const ChunkGrid&) = delete;
+    ChunkGrid& operator=(const ChunkGrid&) = delete;
+
+private:
+
+    enum Direction { LEFT, RIGHT, FRONT, BACK, NUM_DIRECTIONS };
+
+    // a chunk plus the state its coroutine works with. Unless noted, the fields
+    // are guarded by graphMutex:
+    struct Entry {
+        Chunk* chunk;
+        // nullptr when the neighbour isn't loaded:
+        Entry* neighbours[NUM_DIRECTIONS] = { nullptr, nullptr, nullptr, nullptr };
+        // set once the chunk's blocks have been generated:
+        async_event generated;
+        // set once the chunk is within drawRadius (or it's been cancelled):
+        async_event wanted;
+        bool wantsMesh = false;
+        // whether the coroutine is parked on wanted (and so isn't counted in tasksInFlight):
+        bool parked = false;
+        // whether the coroutine is still going. Only accessed from the main thread:
+        bool running = true;
+        // set when the entry's been dropped from the grid before its coroutine finished;
+        // the coroutine skips whatever's left to do and then frees the entry:
+        std::atomic<bool> cancelled = false;
+        // number of neighbouring coroutines that will read this chunk's blocks. An
+        // entry can only be freed once this is zero:
+        int pins = 0;
+    };
+
+    const int voxelSize;
+    const int drawRadius;
+    const int createRadius;
+    const int outerRadius;
+    const int skirtSpacing;
+    const Generator &worldGen;
+    Executors &executors;
+    // for the parts of a chunk's coroutine that have to be on the main thread:
+    GLQueue &glQueue;
+    VertexArena &vertexArena;
+
+    // only ever accessed from the main thread:
+    std::unordered_map<std::pair<int, int>, Entry*, hashPair> entries;
+    std::unordered_map<std::pair<int, int>, Region, hashPair> regions;
+    unsigned int version = 0;
+
+    std::mutex graphMutex;
+    // number of chunk coroutines that are running, queued to run, or waiting on something
+    // other than wanted:
+    std::atomic<int> tasksInFlight;
+
+    int chunkSizeX() const { return Chunk::CHUNK_SIZE_X * voxelSize; }
+    int chunkSizeZ() const { return Chunk::CHUNK_SIZE_Z * voxelSize; }
+
+    Entry* getEntry(int i, int j) const {
+
+        auto search = entries.find(std::make_pair(i, j));
+        if (search == entries.end()) {
+            return nullptr;
+        }
+        return search->second;
+
+    }
+
+    fire_and_forget buildChunk(Entry* entry) {
+
+        co_await resume_on(executors.generation);
+
+        if (!entry->cancelled) {
+
+            entry->chunk->generateBlocks(worldGen);
+            // wakes any neighbours waiting to mesh:
+            entry->generated.set();
+
+            {
+                std::lock_guard lock(graphMutex);
+                if (!entry->wantsMesh && !entry->cancelled) {
+                    entry->parked = true;
+                    tasksInFlight--;
+                }
+            }
+            co_await entry->wanted.wait_on(executors.meshing);
+
+        }
+
+        // at this point, the neighbours are pinned if (and only if) the chunk was wanted:
+        bool neighboursPinned;
+        {
+            std::lock_guard lock(graphMutex);
+            neighboursPinned = entry->wantsMesh;
+        }
+
+        if (neighboursPinned) {
+
+            // NB: the neighbours are pinned, so these links can't change under us
+            // (and pinned chunks are never cancelled, so they will get generated):
+            if (!entry->cancelled) {
+                for (Entry* neighbour : entry->neighbours) {
+                    co_await neighbour->generated.wait_on(executors.meshing);
+                }
+            }
+
+            Chunk::Neighbourhood neighbourhood {
+                entry->neighbours[LEFT]->chunk,
+                entry->neighbours[RIGHT]->chunk,
+                nullptr, // top
+                nullptr, // bottom
+                entry->neighbours[FRONT]->chunk,
+                entry->neighbours[BACK]->chunk
+            };
+
+            // the mesh is written straight into a mapped VBO: the main thread makes and
+            // maps a buffer of the right size, a worker fills it, and then the main thread
+            // unmaps it. If the buffer's contents are lost in the meantime, it's redone:
+            int numFaces = (entry->cancelled ? 0 : entry->chunk->countFaces(neighbourhood));
+            while (!entry->cancelled) {
+
+                co_await glQueue.schedule();
+                if (entry->cancelled) { break; }
+                std::uint32_t* destination = entry->chunk->mapMeshBuffer(numFaces);
+
+                co_await resume_on(executors.meshing);
+                entry->chunk->generateMesh(neighbourhood, destination);
+
+                co_await glQueue.schedule();
+                if (entry->cancelled || entry->chunk->syncMesh()) { break; }
+
+            }
+
+            std::lock_guard lock(graphMutex);
+            for (Entry* neighbour : entry->neighbours) {
+                neighbour->pins--;
+            }
+
+        }
+
+        co_await glQueue.schedule();
+
+        entry->running = false;
+        tasksInFlight--;
+
+        // the grid has already let go of cancelled entries, so it's up to us to free them:
+        if (entry->cancelled) {
+            delete entry->chunk;
+            delete entry;
+        }
+
+    }
+
+    // wakes entry's coroutine if it's parked waiting to be wanted:
+    // NB: graphMutex must be held
+    void wake(Entry* entry) {
+
+        if (entry->parked) {
+            entry->parked = false;
+            tasksInFlight++;
+        }
+
+    }
+
+    void scheduleChunks(const glm::vec3 &position) {
+
+        int currentI = std::floor(position.x / chunkSizeX());
+        int currentJ = std::floor(position.z / chunkSizeZ());
+
+        // chunks can't be positioned past MAX_CHUNK_INDEX (see Chunk), so the grid just
+        // stops there. NB: only chunks with all their neighbours in range get meshed, so
+        // the outermost ones never do:
+        int minI = std::max(currentI - createRadius, -Chunk::MAX_CHUNK_INDEX);
+        int minJ = std::max(currentJ - createRadius, -Chunk::MAX_CHUNK_INDEX);
+        int maxI = std::min(currentI + 1 + createRadius, Chunk::MAX_CHUNK_INDEX);
+        int maxJ = std::min(currentJ + 1 + createRadius, Chunk::MAX_CHUNK_INDEX);
+
+        std::vector<Entry*> toBuild;
+        std::vector<Entry*> toWake;
+        std::unique_lock lock(graphMutex);
+
+        // create Chunks within required area:
+        for (int i = minI; i <= maxI; i++) {
+            for (int j = minJ; j <= maxJ; j++) {
+
+                if (getEntry(i, j) != nullptr) {
+                    // chunk already exists
+                    continue;
+                }
+
+                Entry* entry = new Entry();
+                entry->chunk = new Chunk(glQueue, vertexArena);
+                entry->chunk->setPosition(glm::ivec3(i * chunkSizeX(), 0, j * chunkSizeZ()), voxelSize);
+                entry->chunk->setSkirts(skirtsFor(i, j));
+                entries.insert({ std::make_pair(i, j), entry });
+                addToRegion(i, j, entry->chunk);
+
+                link(entry, LEFT, getEntry(i - 1, j), RIGHT);
+                link(entry, RIGHT, getEntry(i + 1, j), LEFT);
+                link(entry, FRONT, getEntry(i, j + 1), BACK);
+                link(entry, BACK, getEntry(i, j - 1), FRONT);
+
+                tasksInFlight++;
+                toBuild.push_back(entry);
+
+            }
+        }
+
+        // make sure all chunks within draw radius will get a mesh. Their neighbours
+        // all exist at this point, so pin them now (before they can be freed):
+        for (int i = minI + 1; i < maxI; i++) {
+            for (int j = minJ + 1; j < maxJ; j++) {
+                Entry* entry = getEntry(i, j);
+                if (!entry->wantsMesh) {
+                    entry->wantsMesh = true;
+                    for (Entry* neighbour : entry->neighbours) {
+                        neighbour->pins++;
+                    }
+                    wake(entry);
+                    toWake.push_back(entry);
+                }
+            }
+        }
+
+        lock.unlock();
+
+        // NB: starting and waking coroutines can end up running other tasks (if the 
+        // executors' queues are full), which may need graphMutex, so this happens 
+        // once it's been released:
+        for (Entry* entry : toBuild) {
+            buildChunk(entry);
+        }
+        for (Entry* entry : toWake) {
+            entry->wanted.set();
+        }
+
+    }
+
+    static int floorDiv(int a, int b) {
+        return (a >= 0 ? a / b : (a - b + 1) / b);
+    }
+
+    std::uint8_t skirtsFor(int i, int j) const {
+
+        std::uint8_t faces = 0;
+        if (floorDiv(i, skirtSpacing) * skirtSpacing == i) { faces |= 1 << Chunk::LEFT; }
+        if (floorDiv(i + 1, skirtSpacing) * skirtSpacing == i + 1) { faces |= 1 << Chunk::RIGHT; }
+        if (floorDiv(j, skirtSpacing) * skirtSpacing == j) { faces |= 1 << Chunk::BACK; }
+        if (floorDiv(j + 1, skirtSpacing) * skirtSpacing == j + 1) { faces |= 1 << Chunk::FRONT; }
+        return faces;
+
+    }
+
+    void addToRegion(int i, int j, Chunk* chunk) {
+
+        std::pair<int, int> key = std::make_pair(floorDiv(i, REGION_SIZE), floorDiv(j, REGION_SIZE));
+
+        auto search = regions.find(key);
+        if (search == regions.end()) {
+            float xMin = key.first * REGION_SIZE * chunkSizeX();
+            float zMin = key.second * REGION_SIZE * chunkSizeZ();
+            Region region;
+            region.bounds = {
+                xMin, xMin + REGION_SIZE * chunkSizeX(),
+                0.0f, static_cast<float>(Chunk::CHUNK_SIZE_Y),
+                zMin, zMin + REGION_SIZE * chunkSizeZ()
+            };
+            region.chunks.reserve(REGION_SIZE * REGION_SIZE);
+            search = regions.insert({ key, std::move(region) }).first;
+        }
+
+        search->second.chunks.push_back({ i, j, chunk });
+        version++;
+
+    }
+
+    void removeFromRegion(int i, int j, Chunk* chunk) {
+
+        auto search = regions.find(std::make_pair(floorDiv(i, REGION_SIZE), floorDiv(j, REGION_SIZE)));
+        if (search == regions.end()) {
+            throw;
+        }
+
+        std::vector<RegionChunk> &regionChunks = search->second.chunks;
+        for (RegionChunk &regionChunk : regionChunks) {
+            if (regionChunk.chunk == chunk) {
+                regionChunk = regionChunks.back();
+                regionChunks.pop_back();
+                break;
+            }
+        }
+
+        if (regionChunks.empty()) {
+            regions.erase(search);
+        }
+        version++;
+
+    }
+
+    // NB: graphMutex must be held
+    static void link(Entry* entry, Direction direction, Entry* neighbour, Direction opposite) {
+
+        entry->neighbours[direction] = neighbour;
+        if (neighbour != nullptr) {
+            neighbour->neighbours[opposite] = entry;
+        }
+
+    }
+
+    // unlinks entry from the grid, and frees it - or, if its coroutine is still going,
+    // cancels it (and leaves the coroutine to free it):
+    // NB: must be called from the main thread, and entry mustn't be pinned
+    void releaseEntry(Entry* entry) {
+
+        {
+            std::lock_guard lock(graphMutex);
+
+            if (entry->neighbours[LEFT]) { entry->neighbours[LEFT]->neighbours[RIGHT] = nullptr; }
+            if (entry->neighbours[RIGHT]) { entry->neighbours[RIGHT]->neighbours[LEFT] = nullptr; }
+            if (entry->neighbours[FRONT]) { entry->neighbours[FRONT]->neighbours[BACK] = nullptr; }
+            if (entry->neighbours[BACK]) { entry->neighbours[BACK]->neighbours[FRONT] = nullptr; }
+
+            if (entry->running) {
+                entry->cancelled = true;
+                wake(entry);
+            }
+        }
+
+        if (!entry->running) {
+            delete entry->chunk;
+            delete entry;
+            return;
+        }
+
+        // if it's parked waiting to be wanted, this gets it moving again:
+        entry->wanted.set();
+
+    }
+
+    void freeChunks(const glm::vec3 &position) {
+
+        int currentI = std::floor(position.x / chunkSizeX());
+        int currentJ = std::floor(position.z / chunkSizeZ());
+
+        int minI = currentI - outerRadius;
+        int minJ = currentJ - outerRadius;
+        int maxI = currentI + 1 + outerRadius;
+        int maxJ = currentJ + 1 + outerRadius;
+
+        for (auto it = entries.cbegin(); it != entries.cend(); ) {
+
+            std::pair<int, int> key = it->first;
+            Entry* entry = it->second;
+
+            bool pinned;
+            {
+                std::lock_guard lock(graphMutex);
+                pinned = entry->pins > 0;
+            }
+
+            // chunks that neighbouring chunks still need will be freed on a later update:
+            if ((key.first >= minI && key.first <= maxI &&
+                key.second >= minJ && key.second <= maxJ) || pinned) {
+
+                    ++it;
+                    continue;
+            }
+
+            it = entries.erase(it);
+            removeFromRegion(key.first, key.second, entry->chunk);
+            releaseEntry(entry);
+
+        }
+
+    }
+
+};
@@ -2,85 +2,21 @@
 #pragma once
 
 #include <vector>
+#include <array>
+#include <atomic>
 #include <functional>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
 
 #include <glm/glm.hpp>
 
-#include "../libs/shader.h"
 #include "../libs/aabb.h"
+#include "../libs/gl-queue.h"
+#include "../libs/vertex-arena.h"
 #include "./block.h"
 #include "./world-gen.h"
 
-const int FLOATS_PER_VERTEX = 9;
-const int FLOATS_PER_FACE = 54;
-
-// front, back, etc. defined with forward as -z, up as +y and right as +x
-const float front[] = {
-    // positions         // normals           // texture coords
-     0.0f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
-     1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f, 1.0f, 0.0f,
-     0.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f,
-
-     0.0f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f,
-     1.0f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f, 0.0f, 0.0f,
-     1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f, 1.0f, 0.0f
-};
-
-const float back[] = {
-    // positions         // normals           // texture coords
-     1.0f,  0.0f,  0.0f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
-     0.0f,  1.0f,  0.0f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f, 0.0f,
-     1.0f,  1.0f,  0.0f,  0.0f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f,
-
-     1.0f,  0.0f,  0.0f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f,
-     0.0f,  0.0f,  0.0f,  0.0f,  0.0f, -1.0f,  1.0f, 0.0f, 0.0f,
-     0.0f,  1.0f,  0.0f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f, 0.0f
-};
-
-const float top[] = {
-    // positions         // normals           // texture coords
-     0.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-     1.0f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,  1.0f, 1.0f, 0.0f,
-     0.0f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f,
-
-     0.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-     1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f, 0.0f,
-     1.0f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,  1.0f, 1.0f, 0.0f
-};
-
-const float bottom[] = {
-    // positions         // normals           // texture coords
-     1.0f,  0.0f,  1.0f,  0.0f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-     0.0f,  0.0f,  0.0f,  0.0f, -1.0f,  0.0f,  1.0f, 1.0f, 0.0f,
-     1.0f,  0.0f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f,
-
-     1.0f,  0.0f,  1.0f,  0.0f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-     0.0f,  0.0f,  1.0f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f, 0.0f,
-     0.0f,  0.0f,  0.0f,  0.0f, -1.0f,  0.0f,  1.0f, 1.0f, 0.0f
-};
-
-const float left[] = {
-    // positions         // normals           // texture coords
-     0.0f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-     0.0f,  1.0f,  1.0f, -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 0.0f,
-     0.0f,  1.0f,  0.0f, -1.0f,  0.0f,  0.0f,  0.0f, 1.0f, 0.0f,
-
-     0.0f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-     0.0f,  0.0f,  1.0f, -1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
-     0.0f,  1.0f,  1.0f, -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 0.0f
-};
-
-const float right[] = {
-    // positions         // normals           // texture coords
-     1.0f,  0.0f,  1.0f,  1.0f,  0.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-     1.0f,  1.0f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 0.0f,
-     1.0f,  1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f, 0.0f,
-
-     1.0f,  0.0f,  1.0f,  1.0f,  0.0f,  0.0f,  0.0f, 0.0f, 0.0f,
-     1.0f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f,
-     1.0f,  1.0f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 0.0f
-};
-
 class Chunk {
 
 public:
@@ -98,118 +34,311 @@ public:
     // UNINITIALISED - object has been constructed, but blocks haven't been built
     // POSITIONED - chunk has been positioned
     // BLOCKS_GENERATED - Blocks have been built, but there's no mesh
-    // MESH_GENERATED - Blocks and local copy of the mesh has been built
-    // COMPLETE - Blocks and mesh built and mesh has been pushed to GPU
+    // MESH_GENERATED - Blocks built and the mesh written into the (still mapped) staging buffer
+    // COMPLETE - Blocks and mesh built, and the mesh copied into the arena ready to draw
     // (mostly, this has been seperated out in order to make multi-threading easier, and to allow 
     // blocks to be generated before meshes so that when generating meshes we have all the blocks 
     // in the Chunk's neighbours)
+    // NB: status is atomic as chunks are generated/meshed on worker threads, whilst the main 
+    // thread checks which ones are ready to draw
     enum class Status { UNINITIALISED, POSITIONED, BLOCKS_GENERATED, MESH_GENERATED, COMPLETE };
 
     static constexpr int CHUNK_SIZE_X = 16;
     static constexpr int CHUNK_SIZE_Y = 256;
     static constexpr int CHUNK_SIZE_Z = 16;
 
-    Chunk(): status(Status::UNINITIALISED) {
+    // for occlusion culling, chunks are split vertically into sections SECTION_SIZE blocks
+    // high (i.e. cubes, for full detail chunks). For each section, we note which of its
+    // faces can see each other through its non-visible blocks - bit b of connects[a] is
+    // set if faces a and b are connected (see World::render):
+    static constexpr int SECTION_SIZE = 16;
+    enum Face { LEFT, RIGHT, BOTTOM, TOP, BACK, FRONT, NUM_FACES };
+    struct Connectivity {
+        std::uint8_t connects[NUM_FACES];
+    };
 
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
+    // skirts go at most SKIRT_DEPTH blocks (of the chunk's size) down (see setSkirts):
+    static constexpr int SKIRT_DEPTH = 8;
+
+    // meshes are stored as one packed face (two 32 bit words) per quad, which the vertex
+    // shader expands into its two triangles (see shader-block.vs, which has to match):
+    //   word 0: x (19 bits, signed), y (8 bits), face (3 bits), log2(voxelSize) (2 bits)
+    //   word 1: z (19 bits, signed), texture (10 bits), height - 1 (3 bits)
+    // from the lowest bits up. x, y and z are the block's world position in units of the
+    // chunk's voxelSize, and height is in blocks (for skirts; it's 1 otherwise).
+    // NB: so chunks have to be within MAX_VOXEL_COORD voxels of the origin, i.e. chunk
+    // (i, j) of a grid (see ChunkGrid) can only exist if |i| and |j| are no more than
+    // MAX_CHUNK_INDEX (whatever its voxelSize), and the world stops there
+    static constexpr int WORDS_PER_FACE = 2;
+    static constexpr int VERTICES_PER_FACE = 6;
+    static constexpr int MAX_VOXEL_COORD = (1 << 18) - CHUNK_SIZE_X;
+    static constexpr int MAX_CHUNK_INDEX = MAX_VOXEL_COORD / CHUNK_SIZE_X;
+    static constexpr int MAX_TEXTURES = 1 << 10;
+    static_assert(CHUNK_SIZE_X == CHUNK_SIZE_Z, "MAX_VOXEL_COORD assumes square chunks");
+    static_assert(CHUNK_SIZE_Y <= (1 << 8), "y has to fit in 8 bits");
+    static_assert(SKIRT_DEPTH <= (1 << 3), "height - 1 has to fit in 3 bits");
+    static_assert([] {
+        for (const Block::Properties &block : Block::properties) {
+            for (int texture : { block.frontTexture, block.backTexture, block.leftTexture, block.rightTexture, block.topTexture, block.bottomTexture }) {
+                if (texture >= MAX_TEXTURES) { return false; }
+            }
+        }
+        return true;
+    }(), "textures have to fit in 10 bits");
+
+    // the state of the chunk's GPU occlusion query (see OcclusionQueries):
+    struct OcclusionQuery {
+        // created when first needed:
+        GLuint query = 0;
+        // whether the query's been issued, and its result not yet read back:
+        bool pending = false;
+        // the last result read back:
+        bool occluded = false;
+        // (OcclusionQueries') frame numbers for when the pending query was issued, and
+        // when the query that gave the last result was:
+        unsigned int issuedFrame = 0;
+        unsigned int resultFrame = 0;
+    };
 
-    }
+    // a chunk's mesh lives in vertexArena (with its faces in world space), so all
+    // chunks can be drawn in one go.
+    // NB: GL objects are only created once there's a mesh to upload, and are released via 
+    // glQueue, so chunks can be created and destroyed on any thread:
+    Chunk(GLQueue &glQueue, VertexArena &vertexArena): glQueue(glQueue), vertexArena(vertexArena), numFaces(0), 
+        stagingBuffer(0), meshHandle(VertexArena::NO_HANDLE), voxelSize(1), sizeY(CHUNK_SIZE_Y), status(Status::UNINITIALISED) {}
     ~Chunk() {
 
-        glDeleteVertexArrays(1, &VAO);
-        glDeleteBuffers(1, &VBO);
+        if (stagingBuffer != 0) { glQueue.deleteBuffer(stagingBuffer); }
+        if (occlusionQuery.query != 0) { glQueue.deleteQuery(occlusionQuery.query); }
+        if (meshHandle != VertexArena::NO_HANDLE) {
+            VertexArena &arena = vertexArena;
+            VertexArena::Handle handle = meshHandle;
+            glQueue.post([&arena, handle]() { arena.free(handle); });
+        }
 
     }
 
-    void setPosition(const glm::ivec3 &initPosition) {
+    // voxelSize allows for coarse, low detail chunks for use in the distance. Each of their 
+    // blocks is voxelSize blocks wide, high and deep, so the chunk covers voxelSize times 
+    // as much ground in x and z, but still spans CHUNK_SIZE_Y vertically:
+    void setPosition(const glm::ivec3 &initPosition, int initVoxelSize = 1) {
 
         if (status != Status::UNINITIALISED) {
             throw;
         }
 
+        // (and voxelSize has to be a power of two, up to 8, to be packed into faces):
+        if (initVoxelSize < 1 || initVoxelSize > 8 || (initVoxelSize & (initVoxelSize - 1)) != 0 || CHUNK_SIZE_Y % initVoxelSize != 0) {
+            throw;
+        }
+
+        // (ChunkGrid never makes chunks past this, so it really shouldn't happen):
+        if (std::abs(initPosition.x / initVoxelSize) > MAX_VOXEL_COORD || std::abs(initPosition.z / initVoxelSize) > MAX_VOXEL_COORD) {
+            throw;
+        }
+
         position = initPosition;
+        voxelSize = initVoxelSize;
+        voxelPosition = position / voxelSize;
+        voxelShift = 0;
+        while ((1 << voxelShift) < voxelSize) {
+            voxelShift++;
+        }
+        sizeY = CHUNK_SIZE_Y / voxelSize;
+        blocks.resize(CHUNK_SIZE_X * sizeY * CHUNK_SIZE_Z);
 
         boundingBox = {
             static_cast<float>(position.x), 
-            static_cast<float>(position.x + CHUNK_SIZE_X),
+            static_cast<float>(position.x + CHUNK_SIZE_X * voxelSize),
             static_cast<float>(position.y),
             static_cast<float>(position.y + CHUNK_SIZE_Y),
             static_cast<float>(position.z),
-            static_cast<float>(position.z + CHUNK_SIZE_Z)
+            static_cast<float>(position.z + CHUNK_SIZE_Z * voxelSize)
         };
 
         status = Status::POSITIONED;
 
     }
 
+    // the sides of the chunk (bit f for Face f, of LEFT, RIGHT, BACK and FRONT) that get
+    // a skirt: where the chunk meets one at a different level of detail, the terrain won't
+    // quite line up, leaving gaps where the sides of the blocks along the edge were left
+    // out (as the neighbour at the same level covered them). So along these edges, the
+    // top of that hidden part of each column is put in anyway, as one tall face:
+    void setSkirts(std::uint8_t faces) {
+
+        if (status != Status::POSITIONED) {
+            throw;
+        }
+
+        skirts = faces;
+
+    }
+
     void generateBlocks(const WorldGen<CHUNK_SIZE_X, CHUNK_SIZE_Y, CHUNK_SIZE_Z> &worldGen) {
 
         if (status != Status::POSITIONED) {
             throw;
         }
 
-        worldGen(position, blocks);
+        worldGen(position, voxelSize, &blocks[0]);
 
         status = Status::BLOCKS_GENERATED;
 
     }
 
-    // generates the local mesh:
-    void generateMesh(const Neighbourhood& neighbourhood) {
+    // the exact number of faces the mesh will have, so that space can be made for it
+    // before it's generated. The mesh keeps the faces pointing each way together (see
+    // getFirstVertex(Face)), so this also works out where each direction's faces go:
+    int countFaces(const Neighbourhood& neighbourhood) {
 
         if (status != Status::BLOCKS_GENERATED) {
             throw;
         }
 
-        vertices.reserve(overestimateFaces() * FLOATS_PER_FACE);
+        std::array<int, NUM_FACES> counts = {};
+        forEachFace(neighbourhood, [&](int face, int, int, int, int, int) { counts[face]++; });
 
-        buildMesh(neighbourhood);
+        faceStarts[0] = 0;
+        for (int face = 0; face < NUM_FACES; face++) {
+            faceStarts[face + 1] = faceStarts[face] + counts[face];
+        }
+        return faceStarts[NUM_FACES];
+
+    }
+
+    // makes a staging buffer big enough for numFaces faces, and maps it so that the mesh 
+    // can be written straight into it (by generateMesh, on any thread). returns nullptr if
+    // there's nothing to map:
+    // NB: must be called from the main thread
+    std::uint32_t* mapMeshBuffer(int numFaces) {
+
+        if (status != Status::BLOCKS_GENERATED) {
+            throw;
+        }
+
+        this->numFaces = numFaces;
+        if (numFaces == 0) {
+            return nullptr;
+        }
+
+        if (stagingBuffer == 0) {
+            glGenBuffers(1, &stagingBuffer);
+        }
+
+        GLsizeiptr size = numFaces * WORDS_PER_FACE * sizeof(std::uint32_t);
+
+        // NB: the arena can't be mapped directly, as GL 3.3 doesn't allow drawing from a
+        // buffer whilst it's mapped (and the mesh takes a while to write):
+        glBindBuffer(GL_ARRAY_BUFFER, stagingBuffer);
+        glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        // the buffer's brand new, so there's nothing for the driver to synchronise with:
+        void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        return static_cast<std::uint32_t*>(mapped);
+
+    }
+
+    // writes the mesh into destination (as returned by mapMeshBuffer):
+    void generateMesh(const Neighbourhood& neighbourhood, std::uint32_t* destination) {
+
+        if (status != Status::BLOCKS_GENERATED) {
+            throw;
+        }
+
+        // each direction's faces are written into their own part of the buffer:
+        std::array<int, NUM_FACES> next;
+        std::copy(faceStarts.begin(), faceStarts.begin() + NUM_FACES, next.begin());
+        forEachFace(neighbourhood, [&](int face, int x, int y, int z, int texture, int height) {
+            writeFace(destination + next[face] * WORDS_PER_FACE, face, x, y, z, texture, height);
+            next[face]++;
+        });
+
+        // the buffer was sized from countFaces, so this really shouldn't happen:
+        for (int face = 0; face < NUM_FACES; face++) {
+            if (next[face] != faceStarts[face + 1]) {
+                throw;
+            }
+        }
+        if (faceStarts[NUM_FACES] != numFaces) {
+            throw;
+        }
+
+        computeConnectivity();
+        computeHeights();
 
         status = Status::MESH_GENERATED;
 
     }
 
-    // syncs the local mesh with the GPU:
-    void syncMesh() {
+    // unmaps the staging buffer and copies the mesh (GPU side) into the arena. returns false 
+    // if the buffer's contents were lost whilst it was mapped (which GL allows for, e.g. on a 
+    // display mode change), in which case the chunk goes back to BLOCKS_GENERATED and the 
+    // mesh needs redoing. If the arena's full (and can't grow any more), the chunk is still
+    // COMPLETE, but without a mesh, so it just isn't drawn:
+    // NB: must be called from the main thread
+    bool syncMesh() {
 
         if (status != Status::MESH_GENERATED) {
             throw;
         }
 
-        glBindVertexArray(VAO);
+        if (numFaces > 0) {
+
+            glBindBuffer(GL_ARRAY_BUFFER, stagingBuffer);
+            bool intact = (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-        // load vertex data in VBO:
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+            if (!intact) {
+                status = Status::BLOCKS_GENERATED;
+                return false;
+            }
 
-        // position attribute
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-        // normal attribute
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
-        // texture coords
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)(6 * sizeof(float)));
-        glEnableVertexAttribArray(2);
+            if (meshHandle != VertexArena::NO_HANDLE) {
+                vertexArena.free(meshHandle);
+            }
+            meshHandle = vertexArena.allocate(numFaces);
+            if (meshHandle != VertexArena::NO_HANDLE) {
+                vertexArena.copyFrom(stagingBuffer, meshHandle);
+            } else {
+                // no room, so go without:
+                numFaces = 0;
+                faceStarts.fill(0);
+            }
 
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+            // GL holds on to the buffer until the copy's done:
+            glDeleteBuffers(1, &stagingBuffer);
+            stagingBuffer = 0;
+
+        }
 
         status = Status::COMPLETE;
+        return true;
 
     }
 
-    void render(const Shader &shader) const {
-
-        if (status != Status::COMPLETE) { return; }
+    // where the mesh is in the arena, in vertices (i.e. VERTICES_PER_FACE per face), for
+    // drawing with glMultiDrawArrays:
+    // NB: only valid once COMPLETE, and until the arena next allocates (i.e. get it each frame)
+    int getFirstVertex() const {
+        return (meshHandle == VertexArena::NO_HANDLE ? 0 : vertexArena.getFirst(meshHandle) * VERTICES_PER_FACE);
+    }
 
-        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(position));
-        shader.setUniformMat4("model", model);
-        shader.setUniformMat3("normalMatrix", glm::mat3(glm::transpose(glm::inverse(model))));
+    int getNumVertices() const {
+        return numFaces * VERTICES_PER_FACE;
+    }
 
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, vertices.size() / FLOATS_PER_VERTEX);
+    // likewise, but just for the faces pointing in direction face. These are laid out in
+    // the order of Face (so e.g. the LEFT and RIGHT faces together are one range):
+    // NB: only valid once COMPLETE, and until the arena next allocates
+    int getFirstVertex(Face face) const {
+        return getFirstVertex() + faceStarts[face] * VERTICES_PER_FACE;
+    }
 
+    int getNumVertices(Face face) const {
+        return (faceStarts[face + 1] - faceStarts[face]) * VERTICES_PER_FACE;
     }
 
     Status getStatus() const {
@@ -220,132 +349,276 @@ public:
 
     const AABB& getAABB() const { return boundingBox; };
 
+    int getVoxelSize() const { return voxelSize; }
+
+    int getNumSections() const { return sizeY / SECTION_SIZE; }
+
+    // the top of the lowest column of (visible) blocks that goes all the way down, and the
+    // top of the highest visible block. i.e. the chunk's solid below minHeight, and empty
+    // above maxHeight (for horizon culling):
+    // NB: only valid once COMPLETE
+    float getMinHeight() const { return minHeight; }
+    float getMaxHeight() const { return maxHeight; }
+
+    // NB: only valid once COMPLETE
+    const Connectivity& getConnectivity(int section) const {
+        return connectivity[section];
+    }
+
+    // NB: only to be used from the main thread
+    OcclusionQuery& getOcclusionQuery() { return occlusionQuery; }
+
+    // the chunk's place in the (front to back) draw order, as set by World.
+    // NB: only to be used from the main thread
+    int getDrawOrder() const { return drawOrder; }
+    void setDrawOrder(int order) { drawOrder = order; }
+
     Chunk(const Chunk&) = delete;
     Chunk& operator=(const Chunk&) = delete;
 
 private:
 
-    std::vector<float> vertices;
-    Block blocks[CHUNK_SIZE_X][CHUNK_SIZE_Y][CHUNK_SIZE_Z];
-    GLuint VBO, VAO;
+    GLQueue &glQueue;
+    VertexArena &vertexArena;
+    // the mesh itself only lives on the GPU:
+    int numFaces;
+    // where each direction's faces start in the mesh (plus the end):
+    std::array<int, NUM_FACES + 1> faceStarts = {};
+    // only exists whilst the mesh is being written:
+    GLuint stagingBuffer;
+    VertexArena::Handle meshHandle;
+    // blocks are stored as [x][y][z] and there are CHUNK_SIZE_Y / voxelSize of them vertically:
+    std::vector<Block> blocks;
     glm::ivec3 position;
+    int voxelSize;
+    // for packing faces: the position in units of voxelSize, and log2(voxelSize):
+    glm::ivec3 voxelPosition;
+    std::uint32_t voxelShift;
+    int sizeY;
+    std::uint8_t skirts = 0;
     AABB boundingBox;
-    Status status;
+    // one per section, from bottom to top:
+    std::vector<Connectivity> connectivity;
+    float minHeight;
+    float maxHeight;
+    OcclusionQuery occlusionQuery;
+    int drawOrder = 0;
+    std::atomic<Status> status;
+
+    Block& getBlock(int x, int y, int z) {
+        return blocks[(x * sizeY + y) * CHUNK_SIZE_Z + z];
+    }
 
-    // this will over-estimate the number of faces (it assumes that any chunk <-> boundary will require a face)
-    // but with the result that it's quicker to run
-    int overestimateFaces() const {
+    const Block& getBlock(int x, int y, int z) const {
+        return blocks[(x * sizeY + y) * CHUNK_SIZE_Z + z];
+    }
 
-        int numFaces = 0;
+    // flood fills each section's non-visible blocks, noting which faces each connected
+    // pocket touches. Faces touched by the same pocket can see each other:
+    void computeConnectivity() {
 
-        for (int x = 0; x < CHUNK_SIZE_X; x++) {
-            for (int y = 0; y < CHUNK_SIZE_Y; y++) {
-                for (int z = 0; z < CHUNK_SIZE_Z; z++) {
-                    if (!Block::properties[blocks[x][y][z].type].visible) {
-                        continue;
-                    }
-                    if (x == 0 || !Block::properties[blocks[x-1][y][z].type].visible) {
-                        numFaces++;
-                    }
-                    if (x == CHUNK_SIZE_X - 1 || !Block::properties[blocks[x+1][y][z].type].visible) {
-                        numFaces++;
-                    }
-                    if (y == 0 || !Block::properties[blocks[x][y-1][z].type].visible) {
-                        numFaces++;
-                    }
-                    if (y == CHUNK_SIZE_Y - 1 || !Block::properties[blocks[x][y+1][z].type].visible) {
-                        numFaces++;
+        constexpr int SECTION_VOLUME = CHUNK_SIZE_X * SECTION_SIZE * CHUNK_SIZE_Z;
+
+        connectivity.assign(getNumSections(), Connectivity{});
+
+        std::vector<bool> filled(SECTION_VOLUME);
+        std::vector<int> stack;
+        stack.reserve(SECTION_VOLUME);
+
+        // within a section, cells are indexed as (x * SECTION_SIZE + y) * CHUNK_SIZE_Z + z:
+        auto cellIndex = [](int x, int y, int z) { return (x * SECTION_SIZE + y) * CHUNK_SIZE_Z + z; };
+
+        for (int section = 0, l = getNumSections(); section < l; section++) {
+
+            int yOffset = section * SECTION_SIZE;
+
+            // most sections are either all air or all solid, which don't need filling:
+            int numVisible = 0;
+            for (int x = 0; x < CHUNK_SIZE_X; x++) {
+                for (int y = yOffset; y < yOffset + SECTION_SIZE; y++) {
+                    for (int z = 0; z < CHUNK_SIZE_Z; z++) {
+                        numVisible += Block::properties[getBlock(x, y, z).type].visible;
                     }
-                    if (z == 0 || !Block::properties[blocks[x][y][z-1].type].visible) {
-                        numFaces++;
+                }
+            }
+            if (numVisible == SECTION_VOLUME) { continue; }
+            if (numVisible == 0) {
+                for (int face = 0; face < NUM_FACES; face++) {
+                    connectivity[section].connects[face] = (1 << NUM_FACES) - 1;
+                }
+                continue;
+            }
+
+            std::fill(filled.begin(), filled.end(), false);
+
+            for (int start = 0; start < SECTION_VOLUME; start++) {
+
+                int startX = start / (SECTION_SIZE * CHUNK_SIZE_Z);
+                int startY = (start / CHUNK_SIZE_Z) % SECTION_SIZE;
+                int startZ = start % CHUNK_SIZE_Z;
+
+                if (filled[start] || Block::properties[getBlock(startX, startY + yOffset, startZ).type].visible) {
+                    continue;
+                }
+
+                std::uint8_t faces = 0;
+                filled[start] = true;
+                stack.push_back(start);
+
+                while (!stack.empty()) {
+
+                    int cell = stack.back();
+                    stack.pop_back();
+
+                    int x = cell / (SECTION_SIZE * CHUNK_SIZE_Z);
+                    int y = (cell / CHUNK_SIZE_Z) % SECTION_SIZE;
+                    int z = cell % CHUNK_SIZE_Z;
+
+                    if (x == 0) { faces |= 1 << LEFT; }
+                    if (x == CHUNK_SIZE_X - 1) { faces |= 1 << RIGHT; }
+                    if (y == 0) { faces |= 1 << BOTTOM; }
+                    if (y == SECTION_SIZE - 1) { faces |= 1 << TOP; }
+                    if (z == 0) { faces |= 1 << BACK; }
+                    if (z == CHUNK_SIZE_Z - 1) { faces |= 1 << FRONT; }
+
+                    auto visit = [&](int nx, int ny, int nz) {
+                        int index = cellIndex(nx, ny, nz);
+                        if (!filled[index] && !Block::properties[getBlock(nx, ny + yOffset, nz).type].visible) {
+                            filled[index] = true;
+                            stack.push_back(index);
+                        }
+                    };
+
+                    if (x > 0) { visit(x - 1, y, z); }
+                    if (x < CHUNK_SIZE_X - 1) { visit(x + 1, y, z); }
+                    if (y > 0) { visit(x, y - 1, z); }
+                    if (y < SECTION_SIZE - 1) { visit(x, y + 1, z); }
+                    if (z > 0) { visit(x, y, z - 1); }
+                    if (z < CHUNK_SIZE_Z - 1) { visit(x, y, z + 1); }
+
+                }
+
+                for (int face = 0; face < NUM_FACES; face++) {
+                    if (faces & (1 << face)) {
+                        connectivity[section].connects[face] |= faces;
                     }
-                    if (z == CHUNK_SIZE_Z - 1 || !Block::properties[blocks[x][y][z+1].type].visible) {
-                        numFaces++;
+                }
+
+            }
+
+        }
+
+    }
+
+    void computeHeights() {
+
+        int lowest = sizeY;
+        int highest = 0;
+
+        for (int x = 0; x < CHUNK_SIZE_X; x++) {
+            for (int z = 0; z < CHUNK_SIZE_Z; z++) {
+
+                int solid = 0;
+                while (solid < sizeY && Block::properties[getBlock(x, solid, z).type].visible) {
+                    solid++;
+                }
+                lowest = std::min(lowest, solid);
+
+                for (int y = sizeY - 1; y >= highest; y--) {
+                    if (Block::properties[getBlock(x, y, z).type].visible) {
+                        highest = y + 1;
+                        break;
                     }
                 }
+
             }
         }
 
-        return numFaces;
+        minHeight = position.y + lowest * voxelSize;
+        maxHeight = position.y + highest * voxelSize;
 
     }
 
-    void addFace(const float* face, int x, int y, int z, int texture) {
-
-        int startingSize = vertices.size();
-        vertices.insert(vertices.end(), face, face + FLOATS_PER_FACE);
-        for (int i = 0; i < FLOATS_PER_FACE; i += FLOATS_PER_VERTEX) {
-            // shift vertices to correct positions (relative to chunk):
-            vertices[startingSize + i] += x;
-            vertices[startingSize + 1 + i] += y;
-            vertices[startingSize + 2 + i] += z;
-            // set correct index into texture atlas/array:
-            vertices[startingSize + 8 + i] = texture;
-        }
+    // packs the face (see WORDS_PER_FACE) of the block at (x, y, z) within the chunk. Its
+    // position's in world space, so that chunks don't need their own model matrices.
+    // NB: destination is likely to be GPU-visible memory, so it's only ever written to:
+    void writeFace(std::uint32_t* destination, int face, int x, int y, int z, int texture, int height) const {
+
+        std::uint32_t voxelX = (voxelPosition.x + x) & COORD_MASK;
+        std::uint32_t voxelY = voxelPosition.y + y;
+        std::uint32_t voxelZ = (voxelPosition.z + z) & COORD_MASK;
+
+        destination[0] = voxelX | (voxelY << 19) | (face << 27) | (voxelShift << 30);
+        destination[1] = voxelZ | (texture << 19) | ((height - 1) << 29);
 
     }
 
-    void buildMesh(const Neighbourhood& neighbourhood) {
+    static constexpr std::uint32_t COORD_MASK = (1 << 19) - 1;
+
+    // calls addFace(face, x, y, z, texture, height) for each face in the mesh. Always in
+    // the same order, so that counting and then writing faces agree:
+    template <typename F>
+    void forEachFace(const Neighbourhood& neighbourhood, F&& addFace) const {
 
         for (int x = 0; x < CHUNK_SIZE_X; x++) {
-            for (int y = 0; y < CHUNK_SIZE_Y; y++) {
+            for (int y = 0; y < sizeY; y++) {
                 for (int z = 0; z < CHUNK_SIZE_Z; z++) {
 
-                    const Block::Properties &block = Block::properties[blocks[x][y][z].type];
+                    const Block::Properties &block = Block::properties[getBlock(x, y, z).type];
 
                     if (!block.visible) { continue; }
 
                     if (x == 0 && neighbourhood.left == nullptr) {
-                        addFace(left, x, y, z, block.leftTexture);
+                        addFace(LEFT, x, y, z, block.leftTexture, 1);
                     } else {
-                        Block leftNeighbour = (x == 0 ? neighbourhood.left->blocks[CHUNK_SIZE_X-1][y][z] : blocks[x-1][y][z]);
+                        Block leftNeighbour = (x == 0 ? neighbourhood.left->getBlock(CHUNK_SIZE_X-1, y, z) : getBlock(x-1, y, z));
                         if (!Block::properties[leftNeighbour.type].visible) {
-                            addFace(left, x, y, z, block.leftTexture);
+                            addFace(LEFT, x, y, z, block.leftTexture, 1);
                         }
                     }
 
                     if (x == CHUNK_SIZE_X - 1 && neighbourhood.right == nullptr) {
-                        addFace(right, x, y, z, block.rightTexture);
+                        addFace(RIGHT, x, y, z, block.rightTexture, 1);
                     } else {
-                        Block rightNeighbour = (x == CHUNK_SIZE_X - 1 ? neighbourhood.right->blocks[0][y][z] : blocks[x+1][y][z]);
+                        Block rightNeighbour = (x == CHUNK_SIZE_X - 1 ? neighbourhood.right->getBlock(0, y, z) : getBlock(x+1, y, z));
                         if (!Block::properties[rightNeighbour.type].visible) {
-                            addFace(right, x, y, z, block.rightTexture);
+                            addFace(RIGHT, x, y, z, block.rightTexture, 1);
                         }
                     }
 
                     if (y == 0 && neighbourhood.bottom == nullptr) {
-                        addFace(bottom, x, y, z, block.bottomTexture);
+                        addFace(BOTTOM, x, y, z, block.bottomTexture, 1);
                     } else {
-                        Block bottomNeighbour = (y == 0 ? neighbourhood.bottom->blocks[x][CHUNK_SIZE_Y-1][z] : blocks[x][y-1][z]);
+                        Block bottomNeighbour = (y == 0 ? neighbourhood.bottom->getBlock(x, sizeY-1, z) : getBlock(x, y-1, z));
                         if (!Block::properties[bottomNeighbour.type].visible) {
-                            addFace(bottom, x, y, z, block.bottomTexture);
+                            addFace(BOTTOM, x, y, z, block.bottomTexture, 1);
                         }
                     }
 
-                    if (y == CHUNK_SIZE_Y - 1 && neighbourhood.top == nullptr) {
-                        addFace(top, x, y, z, block.topTexture);
+                    if (y == sizeY - 1 && neighbourhood.top == nullptr) {
+                        addFace(TOP, x, y, z, block.topTexture, 1);
                     } else {
-                        Block topNeighbour = (y == CHUNK_SIZE_Y - 1 ? neighbourhood.top->blocks[x][0][z] : blocks[x][y+1][z]);
+                        Block topNeighbour = (y == sizeY - 1 ? neighbourhood.top->getBlock(x, 0, z) : getBlock(x, y+1, z));
                         if (!Block::properties[topNeighbour.type].visible) {
-                            addFace(top, x, y, z, block.topTexture);
+                            addFace(TOP, x, y, z, block.topTexture, 1);
                         }
                     }
 
                     if (z == 0 && neighbourhood.back == nullptr) {
-                        addFace(back, x, y, z, block.backTexture);
+                        addFace(BACK, x, y, z, block.backTexture, 1);
                     } else {
-                        Block backNeighbour = (z == 0 ? neighbourhood.back->blocks[x][y][CHUNK_SIZE_Z-1] : blocks[x][y][z-1]);
+                        Block backNeighbour = (z == 0 ? neighbourhood.back->getBlock(x, y, CHUNK_SIZE_Z-1) : getBlock(x, y, z-1));
                         if (!Block::properties[backNeighbour.type].visible) {
-                            addFace(back, x, y, z, block.backTexture);
+                            addFace(BACK, x, y, z, block.backTexture, 1);
                         }
                     }
 
                     if (z == CHUNK_SIZE_Z-1 && neighbourhood.front == nullptr) {
-                        addFace(front, x, y, z, block.frontTexture);
+                        addFace(FRONT, x, y, z, block.frontTexture, 1);
                     } else {
-                        Block frontNeighbour = (z == CHUNK_SIZE_Z - 1 ? neighbourhood.front->blocks[x][y][0] : blocks[x][y][z+1]);
+                        Block frontNeighbour = (z == CHUNK_SIZE_Z - 1 ? neighbourhood.front->getBlock(x, y, 0) : getBlock(x, y, z+1));
                         if (!Block::properties[frontNeighbour.type].visible) {
-                            addFace(front, x, y, z, block.frontTexture);
+                            addFace(FRONT, x, y, z, block.frontTexture, 1);
                         }
                     }
 
@@ -353,6 +626,54 @@ private:
             }
         }
 
+        // skirts (see setSkirts). NB: only where there's a neighbour, as without one all
+        // the sides along the edge are already there:
+        if ((skirts & (1 << LEFT)) && neighbourhood.left != nullptr) {
+            for (int z = 0; z < CHUNK_SIZE_Z; z++) {
+                addSkirt(LEFT, 0, z, &Block::Properties::leftTexture, [&](int y) { return neighbourhood.left->getBlock(CHUNK_SIZE_X-1, y, z); }, addFace);
+            }
+        }
+        if ((skirts & (1 << RIGHT)) && neighbourhood.right != nullptr) {
+            for (int z = 0; z < CHUNK_SIZE_Z; z++) {
+                addSkirt(RIGHT, CHUNK_SIZE_X-1, z, &Block::Properties::rightTexture, [&](int y) { return neighbourhood.right->getBlock(0, y, z); }, addFace);
+            }
+        }
+        if ((skirts & (1 << BACK)) && neighbourhood.back != nullptr) {
+            for (int x = 0; x < CHUNK_SIZE_X; x++) {
+                addSkirt(BACK, x, 0, &Block::Properties::backTexture, [&](int y) { return neighbourhood.back->getBlock(x, y, CHUNK_SIZE_Z-1); }, addFace);
+            }
+        }
+        if ((skirts & (1 << FRONT)) && neighbourhood.front != nullptr) {
+            for (int x = 0; x < CHUNK_SIZE_X; x++) {
+                addSkirt(FRONT, x, CHUNK_SIZE_Z-1, &Block::Properties::frontTexture, [&](int y) { return neighbourhood.front->getBlock(x, y, 0); }, addFace);
+            }
+        }
+
+    }
+
+    // adds the skirt for the column at (x, z): the highest run of blocks (at most
+    // SKIRT_DEPTH) whose sides are hidden by the blocks next to them, neighbourBlock(y):
+    template <typename G, typename F>
+    void addSkirt(int face, int x, int z, int Block::Properties::* texture, G&& neighbourBlock, F&& addFace) const {
+
+        auto isHidden = [&](int y) {
+            return Block::properties[getBlock(x, y, z).type].visible && Block::properties[neighbourBlock(y).type].visible;
+        };
+
+        int top = sizeY - 1;
+        while (top >= 0 && !isHidden(top)) {
+            top--;
+        }
+        if (top < 0) { return; }
+
+        int bottom = top;
+        while (bottom > 0 && top - bottom + 1 < SKIRT_DEPTH && isHidden(bottom - 1)) {
+            bottom--;
+        }
+
+        // the texture of the lowest block, as the top's likely to be grass:
+        addFace(face, x, bottom, z, Block::properties[getBlock(x, bottom, z).type].*texture, top - bottom + 1);
+
     }
 
 };
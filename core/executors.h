@@ -0,0 +1,92 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "../libs/multi-threading/thread-pool.h"
+
+// a separate thread pool for each kind of background work, so that e.g. a burst of
+// block generation can't hold up meshing of the chunks nearest the player.
+//
+// Each pool's thread count, priority and cpus come from a Config. By default
+// (see defaultConfig), one core is left for the render thread, and the rest are
+// shared out between the pools, so that together they don't oversubscribe the CPU:
+//  - meshing gets half of them, at normal priority
+//  - generation gets the other half, at low priority, so it gives way to meshing
+//    (and the render thread) when there's contention
+// If pinWorkers is set, workers are also kept off the first core entirely, leaving it
+// to the render thread.
+// NB: each pool always has at least one thread, so on a single core machine the pools
+// can't help sharing the core with the render thread
+class Executors {
+
+public:
+
+    struct Config {
+        thread_pool_options generation;
+        thread_pool_options meshing;
+    };
+
+    static Config defaultConfig(bool pinWorkers = false) {
+
+        int meshingThreads = std::max(workerCores() / 2, 1);
+        int generationThreads = std::max(workerCores() - meshingThreads, 1);
+
+        return {
+            makeOptions("generation", generationThreads, thread_priority::low, pinWorkers),
+            makeOptions("meshing", meshingThreads, thread_priority::normal, pinWorkers)
+        };
+
+    }
+
+    explicit Executors(const Config &config = defaultConfig())
+        : generation(config.generation), meshing(config.meshing) {}
+
+    thread_pool generation;
+    thread_pool meshing;
+
+    static std::vector<std::string> getNames() {
+        return { "generation", "meshing" };
+    }
+
+    // in the same order as getNames:
+    std::vector<thread_pool_stats> getStats() const {
+        return { generation.get_stats(), meshing.get_stats() };
+    }
+
+    Executors(const Executors&) = delete;
+    Executors& operator=(const Executors&) = delete;
+
+private:
+
+    static int numCores() {
+        // NB: hardware_concurrency may return 0 if it can't tell:
+        return std::max<int>(std::thread::hardware_concurrency(), 1);
+    }
+
+    // cores left over once the render thread has one:
+    static int workerCores() {
+        return std::max(numCores() - 1, 1);
+    }
+
+    static thread_pool_options makeOptions(const std::string &name, int numThreads, thread_priority priority, bool pinWorkers) {
+
+        thread_pool_options options;
+        options.name = name;
+        options.num_threads = numThreads;
+        options.priority = priority;
+
+        // pinning only makes sense if there's a core to spare:
+        if (pinWorkers && numCores() > 1) {
+            for (int i = 1; i < numCores(); i++) {
+                options.cpus.push_back(i);
+            }
+        }
+
+        return options;
+
+    }
+
+};
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../libs/shader.h"
+#include "../libs/camera.h"
+#include "../libs/gl-queue.h"
+#include "./chunk-grid.h"
+#include "./executors.h"
+#include "../libs/multi-threading/task-group.h"
+
+// a cheap stand in for the terrain beyond where the chunks reach: a SIZE x SIZE grid of
+// samples of the terrain's surface, SPACING blocks apart and centred on the camera, drawn
+// as a single mesh (with a square hole in the middle for the chunks) that fades into the
+// fog. Its cost doesn't depend on the chunks at all.
+//
+// The samples live in a heightmap texture that wraps round (i.e. sample (x, z) is always
+// in texel (x & (SIZE - 1), z & (SIZE - 1))), so as the camera moves, only the rows and
+// columns of samples that have come into range need generating and uploading - the rest
+// stay where they are. And as the mesh's vertices are given by index (and positioned in
+// the vertex shader), the mesh itself never changes.
+//
+// Those few rows are quick enough to do on the spot, but when the camera jumps too far
+// for that (or at the start), the whole grid is regenerated on the generation pool (split
+// into strips, with parallel_for, so it's shared between the pool's threads), and handed back to the main thread (via glQueue) to upload. Until it lands, the old samples
+// are left as they are.
+//
+// NB: expects the shader to be shader-far-terrain, with its uniform blocks already bound
+class FarTerrain {
+
+public:
+
+    static constexpr int SIZE = 128;
+    static constexpr int SPACING = 32;
+
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE needs to be a power of two, so that sample coords can be wrapped with a mask");
+
+    // nothing is drawn within holeRadius of the camera (along x or z):
+    FarTerrain(const ChunkGrid::Generator &worldGen, Executors &executors, GLQueue &glQueue, Shader &shader, float holeRadius, const glm::vec3 &fogColour)
+        : worldGen(worldGen), executors(executors), glQueue(glQueue), shader(shader), holeRadius(holeRadius),
+            hasSamples(false), refilling(false) {
+
+        shader.useShader();
+        farProjectionUniform = shader.getUniform<glm::mat4>("farProjection");
+        firstSampleUniform = shader.getUniform<glm::ivec2>("firstSample");
+        shader.setUniform(shader.getUniform<int>("heightmap"), TEXTURE_UNIT);
+        shader.setUniform(shader.getUniform<int>("gridSize"), SIZE);
+        shader.setUniform(shader.getUniform<float>("spacing"), SPACING);
+        shader.setUniform(shader.getUniform<float>("holeRadius"), holeRadius);
+        shader.setUniform(shader.getUniform<float>("fogStart"), holeRadius);
+        shader.setUniform(shader.getUniform<float>("fogEnd"), FOG_END);
+        shader.setUniform(shader.getUniform<glm::vec3>("fogColour"), fogColour);
+
+        glGenTextures(1, &heightmap);
+        glBindTexture(GL_TEXTURE_2D, heightmap);
+        // NB: it's only ever read with texelFetch, so filtering and wrapping don't apply
+        // (but without mipmaps, it needs a non-mipmap min filter to be complete):
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, SIZE, SIZE, 0, GL_RG, GL_FLOAT, nullptr);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // the mesh covers the grid around the camera's sample, which always has the same
+        // layout, but cells that are entirely inside the hole (wherever the camera is
+        // within its sample's cell) can be left out:
+        std::vector<GLuint> indices;
+        indices.reserve((SIZE - 1) * (SIZE - 1) * 6);
+        for (int i = 0; i < SIZE - 1; i++) {
+            for (int j = 0; j < SIZE - 1; j++) {
+                if (isInHole(i) && isInHole(j)) { continue; }
+                GLuint corner = i * SIZE + j;
+                // anticlockwise, seen from above:
+                for (GLuint index : { corner, corner + 1, corner + SIZE, corner + SIZE, corner + 1, corner + SIZE + 1 }) {
+                    indices.push_back(index);
+                }
+            }
+        }
+        numIndices = indices.size();
+
+        // there are no vertex attributes, but a VAO is still needed to draw anything:
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &EBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+        samples.resize(2 * MAX_SYNC_ROWS * SIZE);
+        scratch.resize(ChunkGrid::Generator::surfaceScratchSize(MAX_SYNC_ROWS, SIZE));
+        refillSamples.resize(2 * SIZE * SIZE);
+        refillScratch.resize(ChunkGrid::Generator::surfaceScratchSize(SIZE, SIZE));
+
+    }
+    // NB: must be destroyed on the main thread (before glQueue)
+    ~FarTerrain() {
+
+        // a refill in flight refers back to us, so it has to land first:
+        while (refilling) {
+            if (!glQueue.runAll()) {
+                std::this_thread::yield();
+            }
+        }
+
+        glDeleteBuffers(1, &EBO);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteTextures(1, &heightmap);
+
+    }
+
+    // brings the samples into line with the camera's position, generating (and uploading)
+    // just the ones that have come into range, or starting a refill if that's too many:
+    // NB: must be called from the main thread
+    void update(const glm::vec3 &position) {
+
+        // nothing's changed until the refill in flight lands:
+        if (refilling) { return; }
+
+        int centreX = std::floor(position.x / SPACING);
+        int centreZ = std::floor(position.z / SPACING);
+
+        if (hasSamples && centreX == firstX + SIZE / 2 && centreZ == firstZ + SIZE / 2) { return; }
+
+        int newFirstX = centreX - SIZE / 2;
+        int newFirstZ = centreZ - SIZE / 2;
+
+        if (!hasSamples || std::abs(newFirstX - firstX) > MAX_SYNC_ROWS || std::abs(newFirstZ - firstZ) > MAX_SYNC_ROWS) {
+            startRefill(newFirstX, newFirstZ);
+            return;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, heightmap);
+
+        // the rows that have come into range (along x), all the way across:
+        if (newFirstX > firstX) {
+            fill(firstX + SIZE, newFirstZ, newFirstX - firstX, SIZE);
+        } else if (newFirstX < firstX) {
+            fill(newFirstX, newFirstZ, firstX - newFirstX, SIZE);
+        }
+        // and the columns (along z), only for the rows that were already there:
+        int keptX = std::max(firstX, newFirstX);
+        int numKeptX = SIZE - std::abs(newFirstX - firstX);
+        if (newFirstZ > firstZ) {
+            fill(keptX, firstZ + SIZE, numKeptX, newFirstZ - firstZ);
+        } else if (newFirstZ < firstZ) {
+            fill(keptX, newFirstZ, numKeptX, firstZ - newFirstZ);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        firstX = newFirstX;
+        firstZ = newFirstZ;
+        hasSamples = true;
+
+    }
+
+    // NB: draws with its own depth range (from just in front of the hole to the far edge),
+    // which doesn't match the camera's, so the depth buffer wants clearing before anything
+    // else is drawn. Changes the shader, and leaves GL_TEXTURE0 as the active texture unit
+    void render(const Camera &camera) {
+
+        if (!hasSamples) { return; }
+
+        shader.useShader();
+        shader.setUniform(farProjectionUniform, camera.calcualateProjectionMatrix(NEAR_PLANE, FAR_PLANE));
+        shader.setUniform(firstSampleUniform, glm::ivec2(firstX, firstZ));
+
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, heightmap);
+
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, (void*)0);
+        glBindVertexArray(0);
+
+        glActiveTexture(GL_TEXTURE0);
+
+    }
+
+    FarTerrain(const FarTerrain&) = delete;
+    FarTerrain& operator=(const FarTerrain&) = delete;
+
+private:
+
+    // the texture atlas is in unit 0:
+    static constexpr int TEXTURE_UNIT = 1;
+    // the terrain's faded out completely by the last sample before the edge of the grid:
+    static constexpr float FOG_END = (SIZE / 2 - 1) * SPACING;
+    // the nearest cells can be well inside the hole (and are then discarded), but the
+    // near plane still has to be in front of them; and the far plane has to reach the
+    // grid's corners (plus a bit, for height):
+    static constexpr float NEAR_PLANE = 4.0f;
+    static constexpr float FAR_PLANE = 1.5f * (SIZE / 2) * SPACING;
+    // a row (or column) of samples takes ~90us to generate, so moves of up to this many
+    // are done on the spot, and anything more is left to a refill:
+    static constexpr int MAX_SYNC_ROWS = 2;
+    // and refills are generated in strips of (up to) this many rows:
+    static constexpr int REFILL_STRIP_ROWS = 8;
+
+    // a region of samples that doesn't wrap round the texture:
+    struct Piece {
+        int x, z, sizeX, sizeZ;
+    };
+    // a piece of a refill, and where its samples and scratch space start:
+    struct RefillStrip {
+        Piece piece;
+        int samplesOffset, scratchOffset;
+    };
+
+    const ChunkGrid::Generator &worldGen;
+    Executors &executors;
+    GLQueue &glQueue;
+    Shader &shader;
+    const float holeRadius;
+    Uniform<glm::mat4> farProjectionUniform;
+    Uniform<glm::ivec2> firstSampleUniform;
+    GLuint heightmap, VAO, EBO;
+    int numIndices;
+    // the samples (in sample coords) at the grid's low x and z corner:
+    int firstX, firstZ;
+    bool hasSamples;
+    // scratch space for fill:
+    std::vector<float> samples;
+    std::vector<float> scratch;
+    // whether there's a refill in flight (NB: only touched on the main thread), and what
+    // it's working on. Only the refill's task touches the rest until it lands:
+    bool refilling;
+    int refillX, refillZ;
+    std::vector<RefillStrip> refillStrips;
+    std::vector<float> refillSamples;
+    std::vector<float> refillScratch;
+
+    // whether the cells in row (or column) n of the mesh are entirely inside the hole,
+    // wherever the camera is in its sample's cell:
+    bool isInHole(int n) const {
+        float from = (n - SIZE / 2) * SPACING;
+        float to = from + SPACING;
+        return from > SPACING - holeRadius && to < holeRadius;
+    }
+
+    // generates and uploads the sizeX x sizeZ samples starting at sample (x, z).
+    // NB: expects the heightmap to be bound, and the region to fit in samples
+    void fill(int x, int z, int sizeX, int sizeZ) {
+
+        forEachPiece(x, z, sizeX, sizeZ, [this](const Piece &piece) {
+            generate(piece, &samples[0], &scratch[0]);
+            upload(piece, &samples[0]);
+        });
+
+    }
+
+    // regenerates the whole grid (starting at sample (x, z)) on the generation pool,
+    // and then uploads it on the main thread:
+    void startRefill(int x, int z) {
+
+        refilling = true;
+        refillX = x;
+        refillZ = z;
+        refillStrips.clear();
+
+        // each strip's samples (and scratch space) follow straight on from the last one's:
+        int samplesOffset = 0;
+        int scratchOffset = 0;
+        forEachPiece(x, z, SIZE, SIZE, [&](const Piece &piece) {
+            for (int row = 0; row < piece.sizeX; row += REFILL_STRIP_ROWS) {
+                Piece strip{ piece.x + row, piece.z, std::min(REFILL_STRIP_ROWS, piece.sizeX - row), piece.sizeZ };
+                refillStrips.push_back({ strip, samplesOffset, scratchOffset });
+                samplesOffset += 2 * strip.sizeX * strip.sizeZ;
+                scratchOffset += ChunkGrid::Generator::surfaceScratchSize(strip.sizeX, strip.sizeZ);
+            }
+        });
+
+        executors.generation.submit([this]() {
+
+            parallel_for(executors.generation, 0, refillStrips.size(), [this](int i) {
+                const RefillStrip &strip = refillStrips[i];
+                generate(strip.piece, &refillSamples[strip.samplesOffset], &refillScratch[strip.scratchOffset]);
+            });
+
+            glQueue.post([this]() { finishRefill(); });
+
+        });
+
+    }
+
+    void finishRefill() {
+
+        glBindTexture(GL_TEXTURE_2D, heightmap);
+        for (const RefillStrip &strip : refillStrips) {
+            upload(strip.piece, &refillSamples[strip.samplesOffset]);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        firstX = refillX;
+        firstZ = refillZ;
+        hasSamples = true;
+        refilling = false;
+
+    }
+
+    // calls f with each of the pieces that the sizeX x sizeZ region starting at sample
+    // (x, z) splits into where it wraps round the texture.
+    // NB: the region mustn't be bigger than the grid
+    template <typename F>
+    static void forEachPiece(int x, int z, int sizeX, int sizeZ, F&& f) {
+
+        int texelX = x & (SIZE - 1);
+        int texelZ = z & (SIZE - 1);
+        if (texelX + sizeX > SIZE) {
+            int first = SIZE - texelX;
+            forEachPiece(x, z, first, sizeZ, f);
+            forEachPiece(x + first, z, sizeX - first, sizeZ, f);
+            return;
+        }
+        if (texelZ + sizeZ > SIZE) {
+            int first = SIZE - texelZ;
+            forEachPiece(x, z, sizeX, first, f);
+            forEachPiece(x, z + first, sizeX, sizeZ - first, f);
+            return;
+        }
+
+        f(Piece{ x, z, sizeX, sizeZ });
+
+    }
+
+    // NB: this is thread-safe (so long as out and scratch aren't shared)
+    void generate(const Piece &piece, float* pieceSamples, float* pieceScratch) const {
+
+        worldGen.surface(piece.x * SPACING, piece.z * SPACING, piece.sizeX, piece.sizeZ, SPACING, pieceSamples, pieceScratch);
+
+    }
+
+    // NB: expects the heightmap to be bound
+    void upload(const Piece &piece, const float* pieceSamples) {
+
+        // the samples come out with x as rows and z across them, which is how the
+        // texture's laid out:
+        glTexSubImage2D(GL_TEXTURE_2D, 0, piece.z & (SIZE - 1), piece.x & (SIZE - 1), piece.sizeZ, piece.sizeX,
+            GL_RG, GL_FLOAT, pieceSamples);
+
+    }
+
+};
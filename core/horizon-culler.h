@@ -0,0 +1,162 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+#include <glm/glm.hpp>
+
+#include "../libs/aabb.h"
+
+// horizon culling: the terrain's a heightmap, so nearby hills hide most of what's behind
+// them. Chunks are fed in from nearest to furthest, and each one's solid part (everything
+// below the lowest column in it) raises the horizon - the steepest slope, looking out from
+// the camera, that's known to be blocked - in the directions it covers. A chunk whose top
+// is below the horizon in every direction it covers is hidden.
+//
+// The horizon is kept as a slope (rise over horizontal distance) per bin of azimuth, and
+// everything's rounded the safe way: an occluder only raises bins it covers completely,
+// only using its lowest slope, and only once it's entirely nearer than the chunk being
+// tested. Whereas a chunk is tested against every bin it touches using its highest slope.
+class HorizonCuller {
+
+public:
+
+    static constexpr int NUM_BINS = 1024;
+
+    HorizonCuller(): horizon(NUM_BINS) {}
+
+    void begin(const glm::vec3 &cameraPosition) {
+
+        camera = cameraPosition;
+        std::fill(horizon.begin(), horizon.end(), -INFINITY);
+        pending = {};
+
+    }
+
+    // box should be the chunk's footprint, with yMin/yMax being the top of the lowest and
+    // highest columns of blocks in it. Chunks must be tested in order of distance (roughly
+    // is fine; anything out of order just blocks less). returns whether it might be visible:
+    bool testAndAdd(const AABB &box) {
+
+        float nearest, furthest;
+        horizontalDistances(box, nearest, furthest);
+
+        // the camera's over (or right next to) it:
+        if (nearest < 1.0f) { return true; }
+
+        float azimuthMin, azimuthMax;
+        azimuthRange(box, azimuthMin, azimuthMax);
+
+        // everything entirely nearer than this chunk can block it:
+        while (!pending.empty() && pending.top().furthest <= nearest) {
+            raise(pending.top());
+            pending.pop();
+        }
+
+        // the steepest slope from the camera to any point on top of the chunk:
+        float rise = box.yMax - camera.y;
+        float highestSlope = rise / (rise >= 0 ? nearest : furthest);
+
+        bool visible = false;
+        int first = binOf(azimuthMin);
+        int last = binOf(azimuthMax);
+        for (int bin = first; ; bin = (bin + 1) % NUM_BINS) {
+            if (highestSlope >= horizon[bin]) {
+                visible = true;
+                break;
+            }
+            if (bin == last) { break; }
+        }
+
+        if (visible) {
+            // the shallowest slope to the top of the solid part, i.e. anything seen at a
+            // shallower slope (through the chunk's footprint) is blocked:
+            float solidRise = box.yMin - camera.y;
+            pending.push({ solidRise / (solidRise >= 0 ? furthest : nearest), azimuthMin, azimuthMax, furthest });
+        }
+
+        return visible;
+
+    }
+
+    HorizonCuller(const HorizonCuller&) = delete;
+    HorizonCuller& operator=(const HorizonCuller&) = delete;
+
+private:
+
+    struct Occluder {
+        float slope;
+        float azimuthMin, azimuthMax;
+        float furthest;
+        bool operator>(const Occluder &other) const { return furthest > other.furthest; }
+    };
+
+    glm::vec3 camera;
+    std::vector<float> horizon;
+    // occluders that have been seen, but can't block anything yet (nearest first):
+    std::priority_queue<Occluder, std::vector<Occluder>, std::greater<Occluder>> pending;
+
+    static constexpr float TWO_PI = 2 * M_PI;
+
+    // azimuth in [0, 2 pi):
+    static int binOf(float azimuth) {
+        int bin = std::floor(azimuth / TWO_PI * NUM_BINS);
+        return ((bin % NUM_BINS) + NUM_BINS) % NUM_BINS;
+    }
+
+    // raises the bins that lie entirely within the occluder's range:
+    void raise(const Occluder &occluder) {
+
+        float binWidth = TWO_PI / NUM_BINS;
+        int first = std::ceil(occluder.azimuthMin / binWidth);
+        int last = std::floor(occluder.azimuthMax / binWidth) - 1;
+
+        for (int bin = first; bin <= last; bin++) {
+            float &binHorizon = horizon[((bin % NUM_BINS) + NUM_BINS) % NUM_BINS];
+            binHorizon = std::max(binHorizon, occluder.slope);
+        }
+
+    }
+
+    void horizontalDistances(const AABB &box, float &nearest, float &furthest) const {
+
+        float dx = std::max({ box.xMin - camera.x, 0.0f, camera.x - box.xMax });
+        float dz = std::max({ box.zMin - camera.z, 0.0f, camera.z - box.zMax });
+        nearest = std::sqrt(dx * dx + dz * dz);
+
+        float fx = std::max(std::abs(box.xMin - camera.x), std::abs(box.xMax - camera.x));
+        float fz = std::max(std::abs(box.zMin - camera.z), std::abs(box.zMax - camera.z));
+        furthest = std::sqrt(fx * fx + fz * fz);
+
+    }
+
+    // the range of azimuths covered by the box's footprint. azimuthMin is in [0, 2 pi), and
+    // azimuthMax is greater than it (so may be more than 2 pi, if the range wraps round):
+    // NB: the camera mustn't be over the box
+    void azimuthRange(const AABB &box, float &azimuthMin, float &azimuthMax) const {
+
+        float centre = std::atan2(0.5f * (box.zMin + box.zMax) - camera.z, 0.5f * (box.xMin + box.xMax) - camera.x);
+
+        float minOffset = 0, maxOffset = 0;
+        float xs[] = { box.xMin, box.xMax };
+        float zs[] = { box.zMin, box.zMax };
+        for (float x : xs) {
+            for (float z : zs) {
+                float offset = std::atan2(z - camera.z, x - camera.x) - centre;
+                if (offset > M_PI) { offset -= TWO_PI; }
+                if (offset < -M_PI) { offset += TWO_PI; }
+                minOffset = std::min(minOffset, offset);
+                maxOffset = std::max(maxOffset, offset);
+            }
+        }
+
+        azimuthMin = centre + minOffset;
+        if (azimuthMin < 0) { azimuthMin += TWO_PI; }
+        azimuthMax = azimuthMin + (maxOffset - minOffset);
+
+    }
+
+};
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include "../libs/camera.h"
+#include "../libs/aabb.h"
+#include "./chunk-grid.h"
+#include "./chunk.h"
+
+// works out which full detail chunks could be seen from the camera, taking into account
+// what's in the way. Starting from the camera's section, it walks outwards (breadth first)
+// into neighbouring sections, but only through faces that the section it's in connects to
+// the face it came in by (see Chunk::Connectivity), and only into sections that are within
+// the view frustum. So anything sealed off by solid blocks - e.g. everything underground,
+// when the camera's above ground - is never reached.
+//
+// A line of sight only ever heads one way along each axis, so there's a separate walk for
+// each octant, which only steps in that octant's three directions. That way, the faces a
+// section can be left by only depend on the face it was entered by (not the route taken to
+// get there), so each section only needs visiting once per face it's entered by.
+// Chunks that aren't ready yet are assumed to be open, so nothing is culled on account
+// of them.
+//
+// NB: meshes are per chunk (i.e. per column), so a chunk is drawn if any of its
+// sections are reached
+class OcclusionCuller {
+
+public:
+
+    // radius (in chunks, around the camera's chunk) should cover the whole grid:
+    OcclusionCuller(int radius): radius(radius), size(2 * radius + 1), enabled(false) {
+
+        columns.resize(size * size);
+        connectivity.resize(size * size);
+        visibleColumns.resize(size * size);
+        enteredBy.resize(size * size * NUM_SECTIONS);
+        walkNumbers.resize(size * size * NUM_SECTIONS);
+        inFrustum.resize(size * size * NUM_SECTIONS);
+
+    }
+
+    void update(const Camera &camera, const ChunkGrid &chunks) {
+
+        const glm::vec3 &position = camera.getPosition();
+        centreI = std::floor(position.x / Chunk::CHUNK_SIZE_X);
+        centreJ = std::floor(position.z / Chunk::CHUNK_SIZE_Z);
+
+        for (int i = 0; i < size; i++) {
+            for (int j = 0; j < size; j++) {
+                Chunk* chunk = chunks.getChunk(centreI - radius + i, centreJ - radius + j);
+                columns[i * size + j] = chunk;
+                connectivity[i * size + j] = (chunk != nullptr && chunk->getStatus() == Chunk::Status::COMPLETE ?
+                    &chunk->getConnectivity(0) : nullptr);
+            }
+        }
+
+        std::fill(visibleColumns.begin(), visibleColumns.end(), false);
+        std::fill(inFrustum.begin(), inFrustum.end(), UNTESTED);
+
+        // if the camera's somewhere we know nothing about, we can't say anything is hidden:
+        enabled = (columns[radius * size + radius] != nullptr && position.y >= 0);
+        if (!enabled) { return; }
+
+        // above the world, lines of sight come in through the top of the top sections:
+        aboveWorld = (position.y >= Chunk::CHUNK_SIZE_Y);
+        startSection = std::min(static_cast<int>(std::floor(position.y / Chunk::SECTION_SIZE)), NUM_SECTIONS - 1);
+        numVisited = 0;
+
+        for (int octant = 0; octant < 8; octant++) {
+            if (aboveWorld && (octant & 2)) { continue; }
+            std::uint8_t directions = (1 << (octant & 1 ? Chunk::RIGHT : Chunk::LEFT)) |
+                (1 << (octant & 2 ? Chunk::TOP : Chunk::BOTTOM)) | (1 << (octant & 4 ? Chunk::FRONT : Chunk::BACK));
+            walk(camera.getFrustum(), directions);
+        }
+
+    }
+
+    // i and j are the chunk's coords in the grid:
+    bool isVisible(int i, int j) const {
+
+        if (!enabled) { return true; }
+
+        i -= centreI - radius;
+        j -= centreJ - radius;
+        if (i < 0 || i >= size || j < 0 || j >= size) {
+            return true;
+        }
+
+        return visibleColumns[i * size + j];
+
+    }
+
+    // how many sections were visited by the last update (across all the walks):
+    int getNumVisited() const { return numVisited; }
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+private:
+
+    static constexpr int NUM_SECTIONS = Chunk::CHUNK_SIZE_Y / Chunk::SECTION_SIZE;
+    static constexpr int START = -1;
+    enum : std::uint8_t { UNTESTED, INSIDE, OUTSIDE };
+    static constexpr std::uint8_t ALL_FACES = (1 << Chunk::NUM_FACES) - 1;
+    // (i, section, j) offsets of the neighbour through each face:
+    static constexpr int FACE_OFFSETS[Chunk::NUM_FACES][3] = {
+        { -1, 0, 0 }, // LEFT
+        { 1, 0, 0 },  // RIGHT
+        { 0, -1, 0 }, // BOTTOM
+        { 0, 1, 0 },  // TOP
+        { 0, 0, -1 }, // BACK
+        { 0, 0, 1 }   // FRONT
+    };
+
+    struct Step {
+        // position within the window around the camera:
+        int i, section, j;
+        // the face it was entered by (or START):
+        int entryFace;
+    };
+
+    const int radius;
+    const int size;
+    bool enabled;
+    int centreI, centreJ, startSection;
+    bool aboveWorld;
+    int numVisited;
+    // the window of chunks around the camera (nullptr where there isn't one):
+    std::vector<Chunk*> columns;
+    // each chunk's connectivity, by section (nullptr if it isn't ready yet):
+    std::vector<const Chunk::Connectivity*> connectivity;
+    std::vector<bool> visibleColumns;
+    // for each section in the window, the faces it's been entered by in the current walk.
+    // Rather than clearing this for every walk, each section notes which walk it was last
+    // entered in (and anything from an earlier walk is ignored):
+    std::vector<std::uint8_t> enteredBy;
+    std::vector<std::uint32_t> walkNumbers;
+    std::uint32_t walkNumber = 0;
+    std::vector<std::uint8_t> inFrustum;
+    std::vector<Step> queue;
+
+    // NB: faces come in opposite pairs:
+    static int opposite(int face) {
+        return face ^ 1;
+    }
+
+
+    // walks out from the camera's section, only stepping in the given directions:
+    void walk(const Frustum &frustum, std::uint8_t directions) {
+
+        walkNumber++;
+        queue.clear();
+
+        if (aboveWorld) {
+            // any top section on this octant's side of the camera:
+            for (int i = 0; i < size; i++) {
+                for (int j = 0; j < size; j++) {
+                    bool inOctant = (directions & (1 << Chunk::RIGHT) ? i >= radius : i <= radius) &&
+                        (directions & (1 << Chunk::FRONT) ? j >= radius : j <= radius);
+                    if (inOctant && columns[i * size + j] != nullptr) {
+                        enter(frustum, i, startSection, j, Chunk::TOP);
+                    }
+                }
+            }
+        } else {
+            queue.push_back({ radius, startSection, radius, START });
+        }
+
+        for (std::size_t next = 0; next < queue.size(); next++) {
+
+            Step step = queue[next];
+            visibleColumns[step.i * size + step.j] = true;
+
+            std::uint8_t exits = exitsFrom(step) & directions;
+
+            for (int face = 0; face < Chunk::NUM_FACES; face++) {
+
+                if (!(exits & (1 << face))) { continue; }
+
+                int i = step.i + FACE_OFFSETS[face][0];
+                int section = step.section + FACE_OFFSETS[face][1];
+                int j = step.j + FACE_OFFSETS[face][2];
+
+                if (i < 0 || i >= size || j < 0 || j >= size || section < 0 || section >= NUM_SECTIONS) { continue; }
+                if (columns[i * size + j] == nullptr) { continue; }
+
+                enter(frustum, i, section, j, opposite(face));
+
+            }
+
+        }
+
+        numVisited += queue.size();
+
+    }
+
+    // queues the section to be visited, unless it's already been entered by the same face
+    // (in this walk) or it's out of view:
+    void enter(const Frustum &frustum, int i, int section, int j, int entryFace) {
+
+        int index = (i * size + j) * NUM_SECTIONS + section;
+        if (walkNumbers[index] != walkNumber) {
+            walkNumbers[index] = walkNumber;
+            enteredBy[index] = 0;
+        }
+        if (enteredBy[index] & (1 << entryFace)) { return; }
+
+        // sections can be reached from several neighbours, so each is only tested once:
+        if (inFrustum[index] == UNTESTED) {
+            AABB bounds = {
+                static_cast<float>((centreI - radius + i) * Chunk::CHUNK_SIZE_X),
+                static_cast<float>((centreI - radius + i + 1) * Chunk::CHUNK_SIZE_X),
+                static_cast<float>(section * Chunk::SECTION_SIZE),
+                static_cast<float>((section + 1) * Chunk::SECTION_SIZE),
+                static_cast<float>((centreJ - radius + j) * Chunk::CHUNK_SIZE_Z),
+                static_cast<float>((centreJ - radius + j + 1) * Chunk::CHUNK_SIZE_Z)
+            };
+            inFrustum[index] = (frustum.intersects(bounds) ? INSIDE : OUTSIDE);
+        }
+        if (inFrustum[index] == OUTSIDE) { return; }
+
+        enteredBy[index] |= 1 << entryFace;
+        queue.push_back({ i, section, j, entryFace });
+
+    }
+
+    std::uint8_t exitsFrom(const Step &step) const {
+
+        if (step.entryFace == START) { return ALL_FACES; }
+
+        const Chunk::Connectivity* sections = connectivity[step.i * size + step.j];
+        if (sections == nullptr) { return ALL_FACES; }
+
+        return sections[step.section].connects[step.entryFace];
+
+    }
+
+};
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <string>
+#include <algorithm>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../libs/shader.h"
+#include "../libs/camera.h"
+#include "../libs/aabb.h"
+#include "./chunk.h"
+
+// GPU occlusion culling: after the chunks have been drawn, each one's bounding box is drawn
+// (with colour and depth writes off) inside an occlusion query, which says whether any of
+// it would have been visible over what's already in the depth buffer. That's only read
+// back once it's ready - a frame or two later - so nothing ever waits on the GPU, and in
+// the meantime the chunk sticks with its previous result. So the price is that a chunk
+// coming out from behind something shows up a frame or so late.
+//
+// NB: it catches things the CPU side culling can't (e.g. chunks behind a cliff in the
+// middle of a chunk, or behind the camera's own hill), but only after they've been drawn
+// once, and each query costs a small draw call
+class OcclusionQueries {
+
+public:
+
+    // results older than this many frames (i.e. from before the chunk last went out of
+    // view) aren't trusted:
+    static constexpr unsigned int MAX_RESULT_AGE = 2;
+
+    OcclusionQueries(): shader(vertexShaderCode, fragmentShaderCode),
+        viewProjectionUniform(shader.getUniform<glm::mat4>("viewProjection")),
+        boxMinUniform(shader.getUniform<glm::vec3>("boxMin")),
+        boxSizeUniform(shader.getUniform<glm::vec3>("boxSize")), frame(0) {
+
+        // a unit cube (36 vertices, as the proxies are drawn without face culling it
+        // doesn't matter which way round the triangles go):
+        float corners[8][3] = {
+            { 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 },
+            { 0, 0, 1 }, { 1, 0, 1 }, { 0, 1, 1 }, { 1, 1, 1 }
+        };
+        int faces[6][4] = {
+            { 0, 2, 6, 4 }, { 1, 5, 7, 3 }, // left, right
+            { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, // bottom, top
+            { 0, 1, 3, 2 }, { 4, 6, 7, 5 }  // back, front
+        };
+        float vertices[NUM_CUBE_VERTICES * 3];
+        int next = 0;
+        for (const int (&face)[4] : faces) {
+            for (int corner : { face[0], face[1], face[2], face[2], face[3], face[0] }) {
+                for (int axis = 0; axis < 3; axis++) {
+                    vertices[next++] = corners[corner][axis];
+                }
+            }
+        }
+
+        glGenVertexArrays(1, &cubeVAO);
+        glGenBuffers(1, &cubeVBO);
+
+        glBindVertexArray(cubeVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+
+    }
+    ~OcclusionQueries() {
+
+        glDeleteBuffers(1, &cubeVBO);
+        glDeleteVertexArrays(1, &cubeVAO);
+
+    }
+
+    // call once per frame, before anything's tested:
+    void beginFrame() {
+        frame++;
+    }
+
+    // picks up the chunk's latest result, if it's arrived (without waiting for it), and
+    // returns whether the chunk was hidden last time it was tested:
+    bool isOccluded(Chunk* chunk) {
+
+        Chunk::OcclusionQuery &occlusionQuery = chunk->getOcclusionQuery();
+
+        if (occlusionQuery.pending) {
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(occlusionQuery.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available == GL_TRUE) {
+                GLuint anySamplesPassed;
+                glGetQueryObjectuiv(occlusionQuery.query, GL_QUERY_RESULT, &anySamplesPassed);
+                occlusionQuery.pending = false;
+                occlusionQuery.occluded = (anySamplesPassed == GL_FALSE);
+                occlusionQuery.resultFrame = occlusionQuery.issuedFrame;
+            }
+        }
+
+        return occlusionQuery.occluded && frame - occlusionQuery.resultFrame <= MAX_RESULT_AGE;
+
+    }
+
+    // sets up to issue queries. NB: changes the shader, and expects the chunks that
+    // are being drawn to already be in the depth buffer
+    void begin(const Camera &camera) {
+
+        cameraPosition = camera.getPosition();
+
+        shader.useShader();
+        shader.setUniform(viewProjectionUniform, camera.calcualateProjectionMatrix() * camera.calcualateViewMatrix());
+        glBindVertexArray(cubeVAO);
+
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        // from inside a box, only its back faces are on screen:
+        glDisable(GL_CULL_FACE);
+        // the box's faces can coincide with the chunk's own surface:
+        glDepthFunc(GL_LEQUAL);
+
+    }
+
+    // tests the chunk's bounding box, unless it's still waiting on a result:
+    void issue(Chunk* chunk) {
+
+        Chunk::OcclusionQuery &occlusionQuery = chunk->getOcclusionQuery();
+        if (occlusionQuery.pending) { return; }
+
+        // nothing's drawn above the highest block:
+        AABB box = chunk->getAABB();
+        box.yMax = chunk->getMaxHeight();
+
+        // if the camera's in (or right next to) the box, the near plane cuts into it, so
+        // it can't be tested - and it's in view anyway:
+        if (cameraPosition.x > box.xMin - NEAR_MARGIN && cameraPosition.x < box.xMax + NEAR_MARGIN &&
+            cameraPosition.y > box.yMin - NEAR_MARGIN && cameraPosition.y < box.yMax + NEAR_MARGIN &&
+            cameraPosition.z > box.zMin - NEAR_MARGIN && cameraPosition.z < box.zMax + NEAR_MARGIN) {
+                occlusionQuery.occluded = false;
+                occlusionQuery.resultFrame = frame;
+                return;
+        }
+
+        if (occlusionQuery.query == 0) {
+            glGenQueries(1, &occlusionQuery.query);
+        }
+
+        shader.setUniform(boxMinUniform, glm::vec3(box.xMin, box.yMin, box.zMin));
+        shader.setUniform(boxSizeUniform, glm::vec3(box.xMax - box.xMin, box.yMax - box.yMin, box.zMax - box.zMin));
+
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, occlusionQuery.query);
+        glDrawArrays(GL_TRIANGLES, 0, NUM_CUBE_VERTICES);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+        occlusionQuery.pending = true;
+        occlusionQuery.issuedFrame = frame;
+
+    }
+
+    // puts back the state begin changed (apart from the shader):
+    void end() {
+
+        glBindVertexArray(0);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+        glEnable(GL_CULL_FACE);
+        glDepthFunc(GL_LESS);
+
+    }
+
+    OcclusionQueries(const OcclusionQueries&) = delete;
+    OcclusionQueries& operator=(const OcclusionQueries&) = delete;
+
+private:
+
+    static constexpr int NUM_CUBE_VERTICES = 36;
+    // comfortably more than the camera's near plane distance:
+    static constexpr float NEAR_MARGIN = 1.0f;
+
+    static constexpr const char* vertexShaderCode = R"(
+        #version 330 core
+
+        uniform mat4 viewProjection;
+        uniform vec3 boxMin;
+        uniform vec3 boxSize;
+
+        layout (location = 0) in vec3 aPos;
+
+        void main() {
+            gl_Position = viewProjection * vec4(boxMin + aPos * boxSize, 1.0);
+        }
+    )";
+
+    static constexpr const char* fragmentShaderCode = R"(
+        #version 330 core
+
+        out vec4 colour;
+
+        void main() {
+            colour = vec4(1.0);
+        }
+    )";
+
+    Shader shader;
+    Uniform<glm::mat4> viewProjectionUniform;
+    Uniform<glm::vec3> boxMinUniform;
+    Uniform<glm::vec3> boxSizeUniform;
+    GLuint cubeVBO, cubeVAO;
+    unsigned int frame;
+    glm::vec3 cameraPosition;
+
+};
@@ -1,9 +1,11 @@
 
 #pragma once
 
+#include <cstdlib>
+
 #include <glm/glm.hpp>
 
-#include "../libs/perlin.h"
+#include "../libs/noise-graph.h"
 #include "./block.h"
 
 template <int CHUNK_SIZE_X, int CHUNK_SIZE_Y, int CHUNK_SIZE_Z>
@@ -11,36 +13,43 @@ class WorldGen {
 
 public:
 
-    WorldGen(): noise(1234) {}
+    WorldGen(): terrain(compileTerrain(SEED)) {}
 
+    // fills blocks (stored as [x][y][z]) for the chunk at chunkPosition. Each block is 
+    // voxelSize blocks across, so that low detail chunks can be generated directly by 
+    // sampling the terrain at a lower resolution, rather than generating every block 
+    // and then downsampling. There are CHUNK_SIZE_Y / voxelSize blocks vertically.
     // NB: this is thread-safe
-    void operator()(const glm::ivec3 &chunkPosition, Block (&blocks)[CHUNK_SIZE_X][CHUNK_SIZE_Y][CHUNK_SIZE_Z]) const {
+    void operator()(const glm::ivec3 &chunkPosition, int voxelSize, Block* blocks) const {
+
+        const int sizeY = CHUNK_SIZE_Y / voxelSize;
+
+        // heights for the whole chunk are worked out in one batch:
+        float heights[NUM_HEIGHTS][CHUNK_SIZE_X][CHUNK_SIZE_Z];
+        terrain.evaluate(chunkPosition.x, chunkPosition.z, CHUNK_SIZE_X, CHUNK_SIZE_Z, voxelSize, &heights[0][0][0]);
 
         for (int x = 0; x < CHUNK_SIZE_X; x++) {
             for (int z = 0; z < CHUNK_SIZE_Z; z++) {
 
-                const int topSoilHeight = 200 + 4 * noise.noise(static_cast<float>(x + chunkPosition.x) / CHUNK_SIZE_X, static_cast<float>(z + chunkPosition.z) / CHUNK_SIZE_Z, 1) 
-                                        + 16 * noise.noise((static_cast<float>(x + chunkPosition.x) /  CHUNK_SIZE_X) / 4, (static_cast<float>(z + chunkPosition.z) / CHUNK_SIZE_Z) / 4, 1)
-                                        + 32 * noise.noise((static_cast<float>(x + chunkPosition.x) /  CHUNK_SIZE_X) / 8, (static_cast<float>(z + chunkPosition.z) / CHUNK_SIZE_Z) / 8, 1);
-                const int rockHeight = topSoilHeight - 14 + 2 * noise.noise(static_cast<float>(x + chunkPosition.x) / CHUNK_SIZE_X, static_cast<float>(z + chunkPosition.z) / CHUNK_SIZE_Z, 2) 
-                                        + fmax(0, 18 * noise.noise((static_cast<float>(x + chunkPosition.x) /  CHUNK_SIZE_X), (static_cast<float>(z + chunkPosition.z) / CHUNK_SIZE_Z), 2));
-                const int waterLevel = 219;
+                const int topSoilHeight = heights[TOP_SOIL_HEIGHT][x][z];
+                const int rockHeight = heights[ROCK_HEIGHT][x][z];
                 
-                for (int y = 0; y < CHUNK_SIZE_Y; y++) {
+                for (int y = 0; y < sizeY; y++) {
 
-                    int worldY = y + chunkPosition.y;
+                    // for big blocks, consider the middle of the block:
+                    int worldY = y * voxelSize + voxelSize / 2 + chunkPosition.y;
+                    Block &block = blocks[(x * sizeY + y) * CHUNK_SIZE_Z + z];
 
                     if (worldY <= rockHeight) {
-                        blocks[x][y][z].type = Block::ROCK;
+                        block.type = Block::ROCK;
                     } else {
-                        if (worldY == topSoilHeight) {
-                            blocks[x][y][z].type = Block::GRASS;
-                        } else if (worldY < topSoilHeight) {
-                            blocks[x][y][z].type = Block::DIRT;
-                        } else if (worldY < waterLevel) {
-                            blocks[x][y][z].type = Block::WATER;
+                        if (worldY <= topSoilHeight) {
+                            // the top most block of soil is grass:
+                            block.type = (topSoilHeight < worldY + voxelSize ? Block::GRASS : Block::DIRT);
+                        } else if (worldY < WATER_LEVEL) {
+                            block.type = Block::WATER;
                         } else {
-                            blocks[x][y][z].type = Block::AIR;
+                            block.type = Block::AIR;
                         }
                     }
 
@@ -48,13 +57,192 @@ public:
             }
         }
 
+        // trees would be lost in big blocks, so they're only placed in full detail chunks:
+        if (voxelSize == 1) {
+            placeTrees(chunkPosition, blocks);
+        }
+
     }
 
+    // what the terrain looks like from a distance, at a sizeX by sizeZ grid of columns
+    // starting at world position (x, z), step blocks apart. For column (i, j), the height
+    // of the top of the ground (or water) is written to out[2 * (i * sizeZ + j)], and what
+    // it's made of (one of the SURFACE_ values) to the float after that. scratch needs room
+    // for surfaceScratchSize(sizeX, sizeZ) floats, and is left full of junk.
+    // NB: this is thread-safe (so long as each thread has its own out and scratch)
+    void surface(int x, int z, int sizeX, int sizeZ, int step, float* out, float* scratch) const {
+
+        terrain.evaluate(x, z, sizeX, sizeZ, step, scratch);
+
+        const float* topSoilHeights = &scratch[TOP_SOIL_HEIGHT * sizeX * sizeZ];
+        const float* rockHeights = &scratch[ROCK_HEIGHT * sizeX * sizeZ];
+
+        // (rounded the same way as in operator()):
+        for (int i = 0, l = sizeX * sizeZ; i < l; i++) {
+            const int topSoilHeight = topSoilHeights[i];
+            const int rockHeight = rockHeights[i];
+            if (topSoilHeight + 1 < WATER_LEVEL) {
+                out[2 * i] = WATER_LEVEL;
+                out[2 * i + 1] = SURFACE_WATER;
+            } else {
+                out[2 * i] = topSoilHeight + 1;
+                out[2 * i + 1] = (topSoilHeight <= rockHeight ? SURFACE_ROCK : SURFACE_GRASS);
+            }
+        }
+
+    }
+
+    static constexpr int surfaceScratchSize(int sizeX, int sizeZ) {
+        return NUM_HEIGHTS * sizeX * sizeZ;
+    }
+
+    static constexpr int SURFACE_GRASS = 0;
+    static constexpr int SURFACE_ROCK = 1;
+    static constexpr int SURFACE_WATER = 2;
+
     WorldGen(const WorldGen&) = delete;
     WorldGen& operator=(const WorldGen&) = delete;
 
 private:
 
-    PerlinNoise noise;
+    static constexpr unsigned int SEED = 1234;
+    static constexpr int WATER_LEVEL = 219;
+
+    // trees are placed on a grid of TREE_CELL_SIZE x TREE_CELL_SIZE cells of columns, with
+    // at most one tree per cell. Whether a cell has a tree, and where, depends only on a
+    // hash of the cell's coords. So a chunk can work out every tree that overlaps it (i.e.
+    // those in cells within TREE_RADIUS of it) without waiting for its neighbours:
+    static constexpr int TREE_CELL_SIZE = 8;
+    static constexpr int TREE_RADIUS = 2;
+    static constexpr unsigned int TREE_CHANCE = 160; // out of 256
+
+    // indices of the outputs of terrain:
+    static constexpr int TOP_SOIL_HEIGHT = 0;
+    static constexpr int ROCK_HEIGHT = 1;
+    static constexpr int NUM_HEIGHTS = 2;
+
+    NoisePlan terrain;
+
+    // describes the terrain as a graph of noise, and compiles it into a plan whose
+    // outputs are ordered as TOP_SOIL_HEIGHT etc.
+    static NoisePlan compileTerrain(unsigned int seed) {
+
+        NoiseGraph graph;
+
+        // rolling hills, with detail at a few different scales:
+        NoiseGraph::Node detail = graph.noise(1.0 / CHUNK_SIZE_X, 1);
+        NoiseGraph::Node hills = graph.noise(1.0 / (CHUNK_SIZE_X * 4), 1);
+        NoiseGraph::Node mountains = graph.noise(1.0 / (CHUNK_SIZE_X * 8), 1);
+        NoiseGraph::Node topSoil = graph.add(graph.scale(detail, 4), graph.scale(hills, 16));
+        topSoil = graph.add(topSoil, graph.scale(mountains, 32));
+        topSoil = graph.floor(graph.add(topSoil, 200.0f));
+
+        // rock sits a varying depth below the top soil, occasionally poking through:
+        NoiseGraph::Node rockDetail = graph.noise(1.0 / CHUNK_SIZE_X, 2);
+        NoiseGraph::Node rock = graph.add(graph.scale(rockDetail, 2), graph.clamp(graph.scale(rockDetail, 18), 0));
+        rock = graph.floor(graph.add(graph.add(topSoil, rock), -14.0f));
+
+        return NoisePlan(graph, { topSoil, rock }, seed);
+
+    }
+
+    // a cheap, well mixed hash of cell coords (based on the murmur3 finaliser):
+    static unsigned int hashCell(int x, int z) {
+
+        unsigned int h = SEED;
+        h ^= static_cast<unsigned int>(x) * 0x85ebca6bu;
+        h = (h << 13) | (h >> 19);
+        h ^= static_cast<unsigned int>(z) * 0xc2b2ae35u;
+        h ^= h >> 16;
+        h *= 0x85ebca6bu;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35u;
+        h ^= h >> 16;
+        return h;
+
+    }
+
+    // NB: blocks are only ever written if they're within the chunk, and leaves never 
+    // replace anything but air, so the result doesn't depend on the order trees are placed
+    void placeTrees(const glm::ivec3 &chunkPosition, Block* blocks) const {
+
+        auto floorDiv = [](int a, int b) { return (a >= 0 ? a / b : (a - b + 1) / b); };
+
+        int minCellX = floorDiv(chunkPosition.x - TREE_RADIUS, TREE_CELL_SIZE);
+        int maxCellX = floorDiv(chunkPosition.x + CHUNK_SIZE_X - 1 + TREE_RADIUS, TREE_CELL_SIZE);
+        int minCellZ = floorDiv(chunkPosition.z - TREE_RADIUS, TREE_CELL_SIZE);
+        int maxCellZ = floorDiv(chunkPosition.z + CHUNK_SIZE_Z - 1 + TREE_RADIUS, TREE_CELL_SIZE);
+
+        for (int cellX = minCellX; cellX <= maxCellX; cellX++) {
+            for (int cellZ = minCellZ; cellZ <= maxCellZ; cellZ++) {
+
+                unsigned int hash = hashCell(cellX, cellZ);
+
+                if ((hash & 255) >= TREE_CHANCE) { continue; }
+
+                // world coords of the trunk:
+                int trunkX = cellX * TREE_CELL_SIZE + ((hash >> 8) & 255) % TREE_CELL_SIZE;
+                int trunkZ = cellZ * TREE_CELL_SIZE + ((hash >> 16) & 255) % TREE_CELL_SIZE;
+                int trunkHeight = 4 + ((hash >> 24) % 3);
+
+                if (trunkX < chunkPosition.x - TREE_RADIUS || trunkX >= chunkPosition.x + CHUNK_SIZE_X + TREE_RADIUS ||
+                    trunkZ < chunkPosition.z - TREE_RADIUS || trunkZ >= chunkPosition.z + CHUNK_SIZE_Z + TREE_RADIUS) {
+                        continue;
+                }
+
+                // the trunk's column may well be in another chunk, so get the ground 
+                // height straight from the noise rather than from blocks:
+                float heights[NUM_HEIGHTS];
+                terrain.evaluate(trunkX, trunkZ, 1, 1, 1, heights);
+                const int ground = heights[TOP_SOIL_HEIGHT];
+
+                // only grow trees on grass:
+                if (ground < WATER_LEVEL || heights[ROCK_HEIGHT] >= ground) { continue; }
+
+                const int top = ground + trunkHeight;
+
+                // leaves; a wide canopy around the top of the trunk, narrowing above it:
+                for (int y = top - 2; y <= top + 1; y++) {
+                    int radius = (y < top ? TREE_RADIUS : 1);
+                    for (int dx = -radius; dx <= radius; dx++) {
+                        for (int dz = -radius; dz <= radius; dz++) {
+                            // round off the corners:
+                            if (radius > 1 && std::abs(dx) == radius && std::abs(dz) == radius) { continue; }
+                            if (y == top + 1 && dx != 0 && dz != 0) { continue; }
+                            setBlock(chunkPosition, blocks, trunkX + dx, y, trunkZ + dz, Block::LEAVES);
+                        }
+                    }
+                }
+
+                for (int y = ground + 1; y < top; y++) {
+                    setBlock(chunkPosition, blocks, trunkX, y, trunkZ, Block::WOOD);
+                }
+
+            }
+        }
+
+    }
+
+    // sets the block at world coords (x, y, z) if it's within the chunk:
+    static void setBlock(const glm::ivec3 &chunkPosition, Block* blocks, 
+                            int x, int y, int z, int type) {
+
+        x -= chunkPosition.x;
+        y -= chunkPosition.y;
+        z -= chunkPosition.z;
+
+        if (x < 0 || x >= CHUNK_SIZE_X || y < 0 || y >= CHUNK_SIZE_Y || z < 0 || z >= CHUNK_SIZE_Z) {
+            return;
+        }
+
+        Block &block = blocks[(x * CHUNK_SIZE_Y + y) * CHUNK_SIZE_Z + z];
+
+        if (type == Block::LEAVES && block.type != Block::AIR) {
+            return;
+        }
+
+        block.type = type;
+
+    }
 
 };
@@ -2,18 +2,27 @@
 #pragma once
 
 #include <tuple>
-#include <unordered_map>
+#include <array>
+#include <memory>
+#include <unordered_set>
 #include <math.h>
 #include <algorithm>
 #include <functional>
+#include <chrono>
 
 #include <glm/glm.hpp>
 
 #include "../libs/camera.h"
 #include "../libs/aabb.h"
-#include "../libs/multi-threading/thread-pool.h"
-#include "../libs/multi-threading/latch.h"
+#include "../libs/shader.h"
+#include "../libs/gl-queue.h"
+#include "../libs/vertex-arena.h"
+#include "./executors.h"
 #include "../helpers/timer.h"
+#include "./chunk-grid.h"
+#include "./occlusion-culler.h"
+#include "./horizon-culler.h"
+#include "./occlusion-queries.h"
 #include "./chunk.h"
 #include "./block.h"
 #include "./world-gen.h"
@@ -26,257 +35,395 @@ class World {
 
 public:
 
-    // chunks will be created and their blocks generated when they are 
-    // within CREATE_RADIUS. They will have their meshes generated when 
-    // they are within DRAW_RADIUS; and they will be freed when they are 
-    // outside OUTER_RADIUS:
-    // NB: radius is a bit of a misnomer as currently we're considering 
-    // these boundaries to be square:
-    static constexpr int DRAW_RADIUS = 16;
-    static constexpr int CREATE_RADIUS = DRAW_RADIUS + 1;
-    static constexpr int OUTER_RADIUS = CREATE_RADIUS + 1;
-
-    World() {
+    // chunks come in NUM_LEVELS levels of detail, each with its own ChunkGrid. Level 0 is
+    // full detail, and each level after that is generated directly with blocks LEVEL_RATIO
+    // times the size of the level before's. So each of its chunks covers LEVEL_RATIO x
+    // LEVEL_RATIO chunks of the level before (its 'children').
+    //
+    // every level is drawn within LEVEL_DRAW_RADIUS of its own chunks of the player (see
+    // ChunkGrid), so each reaches twice as far as the one before, for about the same
+    // number of triangles. A chunk is drawn in place of its children until they're
+    // all ready:
+    static constexpr int NUM_LEVELS = 3;
+    static constexpr int LEVEL_RATIO = 2;
+    static constexpr int LEVEL_DRAW_RADIUS = 8;
+
+    // full detail chunks are drawn within DRAW_RADIUS chunks of the player:
+    static constexpr int DRAW_RADIUS = LEVEL_DRAW_RADIUS;
+
+    // and chunks of some level are drawn at least DRAW_DISTANCE blocks from the player
+    // (along x and z) in every direction (i.e. LEVEL_DRAW_RADIUS of the coarsest level's
+    // chunks):
+    static constexpr int DRAW_DISTANCE = [] {
+        int distance = LEVEL_DRAW_RADIUS * Chunk::CHUNK_SIZE_X;
+        for (int level = 1; level < NUM_LEVELS; level++) {
+            distance *= LEVEL_RATIO;
+        }
+        return distance;
+    }();
+
+    // how long each update can spend on GL work handed over by the worker threads
+    // (mainly uploading meshes). Anything left over carries over to the next frame:
+    static constexpr std::chrono::microseconds GL_QUEUE_BUDGET{2000};
+
+    // all chunk meshes share one buffer of packed faces (see VertexArena and Chunk). It
+    // starts off big enough for the initial world (so it shouldn't need to grow in practice),
+    // unless the GPU's buffer textures can't be that big, in which case it's capped (and
+    // any chunks that don't fit go undrawn):
+    static constexpr int INITIAL_ARENA_FACES = 1 << 20;
+
+    // the block shader reads the faces from this texture unit (the texture atlas is in 0):
+    static constexpr int FACES_TEXTURE_UNIT = 2;
+
+    // executorsConfig sets how many threads generate and mesh chunks (and at what priority):
+    explicit World(const Executors::Config &executorsConfig = Executors::defaultConfig())
+        : vertexArena(Chunk::WORDS_PER_FACE * sizeof(std::uint32_t), GL_RG32UI, INITIAL_ARENA_FACES),
+        executors(executorsConfig), occlusionCuller(DRAW_RADIUS + 3), occlusionQueriesEnabled(false) {
+
+        int voxelSize = 1;
+        for (Level &level : levels) {
+            // full detail chunks only ever meet other levels along the edges of the chunks
+            // above them, but past that, any edge can be next to a finer level:
+            level.chunks = std::make_unique<ChunkGrid>(voxelSize, LEVEL_DRAW_RADIUS, (voxelSize == 1 ? LEVEL_RATIO : 1),
+                worldGen, executors, glQueue, vertexArena);
+            voxelSize *= LEVEL_RATIO;
+        }
 
-        int maxNumChunks = std::pow(OUTER_RADIUS + 1, 2);
+        int maxNumChunks = NUM_LEVELS * std::pow(2 * LEVEL_DRAW_RADIUS + 6, 2);
 
+        orderKeys.reserve(maxNumChunks);
+        drawSlots.reserve(maxNumChunks);
         drawList.reserve(maxNumChunks);
-        chunkProcessingList.reserve(maxNumChunks);
-
-    }
-
-    ~World() {
-
-        for (auto const& [key, chunk] : chunks) {
-            delete chunk;
-        }
+        partialList.reserve(maxNumChunks);
+        partialBounds.reserve(maxNumChunks);
+        visibleIndices.reserve(maxNumChunks);
+        // (a chunk's faces can be split into as many as 3 ranges, see addDrawRanges):
+        drawFirsts.reserve(3 * maxNumChunks);
+        drawCounts.reserve(3 * maxNumChunks);
 
     }
 
+    // blocks until the chunks around position are all ready:
     void init(const glm::vec3 &position) {
 
-        buildChunks(position);
+        update(position);
+        for (Level &level : levels) {
+            level.chunks->waitUntilIdle();
+        }
+        updateCovered();
 
     }
 
+    // NB: this doesn't wait for chunks to be generated and meshed - that happens 
+    // in the background, and chunks are drawn as they become ready
     void update(const glm::vec3 &position) {
 
-        freeChunks(position);
-        buildChunks(position);
+        glQueue.run(GL_QUEUE_BUDGET);
+        for (Level &level : levels) {
+            level.chunks->update(position);
+        }
+        updateCovered();
 
     }
 
-    void render(const Camera &camera, const Shader &shader) {
+    // NB: expects the block shader to already be in use
+    void render(const Camera &camera) {
 
         drawList.clear();
+        partialList.clear();
+        partialBounds.clear();
+
+        const Frustum &frustum = camera.getFrustum();
+        occlusionCuller.update(camera, *levels[0].chunks);
+        updateDrawOrder(camera.getPosition());
+
+        for (int level = 0; level < NUM_LEVELS; level++) {
+            levels[level].chunks->forEachRegion([&](const ChunkGrid::Region &region) {
+                Frustum::Overlap overlap = frustum.classify(region.bounds);
+                if (overlap == Frustum::Overlap::OUTSIDE) { return; }
+                for (const ChunkGrid::RegionChunk &regionChunk : region.chunks) {
+                    // chunks are drawn unless the levels below cover them, and only if the
+                    // level above is covered (i.e. isn't being drawn in their place). And
+                    // full detail chunks hidden behind the terrain aren't drawn at all:
+                    Chunk* chunk = regionChunk.chunk;
+                    if (chunk->getStatus() == Chunk::Status::COMPLETE && !isCovered(level, regionChunk.i, regionChunk.j) &&
+                        (level == NUM_LEVELS - 1 || isCovered(level + 1, floorDiv(regionChunk.i, LEVEL_RATIO), floorDiv(regionChunk.j, LEVEL_RATIO))) &&
+                        (level > 0 || occlusionCuller.isVisible(regionChunk.i, regionChunk.j))) {
+                            addVisible(overlap, chunk);
+                    }
+                }
+            });
+        }
+
+        // then the chunks in regions that straddle the frustum are culled individually,
+        // all in one go:
+        visibleIndices.clear();
+        frustum.cull(partialBounds, visibleIndices);
+        for (int index : visibleIndices) {
+            Chunk* chunk = partialList[index];
+            drawSlots[chunk->getDrawOrder()] = chunk;
+        }
 
-        // center of the chunks will be the chunk's position + Chunk::CHUNK_SIZE_X / 2.0 etc. 
-        // we can do the + Chunk::CHUNK_SIZE_X bit here to avoid repeating it for each chunk:
-        float offsetCameraX = camera.getPosition().x - Chunk::CHUNK_SIZE_X / 2.0;
-        float offsetCameraZ = camera.getPosition().z - Chunk::CHUNK_SIZE_Z / 2.0;
+        // and everything's read back out of its slot, giving the chunks front to back:
+        for (Chunk* &slot : drawSlots) {
+            if (slot != nullptr) {
+                drawList.push_back(slot);
+                slot = nullptr;
+            }
+        }
 
-        for (auto const& [key, chunk] : chunks) {
-            if (camera.canSee(chunk->getAABB()) && chunk->getStatus() == Chunk::Status::COMPLETE) {
-                const glm::ivec3& chunkPos = chunk->getPosition();
-                drawList.emplace_back(chunk, 
-                    std::pow(chunkPos.x - offsetCameraX, 2) + std::pow(chunkPos.z - offsetCameraZ, 2));
+        // then, working outwards, drop whatever's hidden behind nearer hills:
+        horizonCuller.begin(camera.getPosition());
+        int numUnoccluded = 0;
+        for (Chunk* chunk : drawList) {
+            AABB heights = chunk->getAABB();
+            heights.yMin = chunk->getMinHeight();
+            heights.yMax = chunk->getMaxHeight();
+            if (horizonCuller.testAndAdd(heights)) {
+                drawList[numUnoccluded++] = chunk;
             }
         }
+        drawList.resize(numUnoccluded);
+
+        // everything's in the one buffer, with vertices in world space, so the whole lot
+        // can go in a single draw call. With occlusion queries on, chunks that were hidden
+        // last time they were tested are left out. And of the rest, only the faces that
+        // can point towards the camera are drawn:
+        occlusionQueries.beginFrame();
+        drawFirsts.clear();
+        drawCounts.clear();
+        for (Chunk* chunk : drawList) {
+            if (chunk->getNumVertices() == 0) { continue; }
+            if (occlusionQueriesEnabled && occlusionQueries.isOccluded(chunk)) { continue; }
+            addDrawRanges(chunk, camera.getPosition());
+        }
 
-        std::sort(drawList.begin(), drawList.end(), [](const VisibleChunk &a, const VisibleChunk &b) {
-            return a.distanceSquared < b.distanceSquared;
-        });
+        if (!drawFirsts.empty()) {
+            vertexArena.bind(GL_TEXTURE0 + FACES_TEXTURE_UNIT);
+            glMultiDrawArrays(GL_TRIANGLES, &drawFirsts[0], &drawCounts[0], drawFirsts.size());
+            glActiveTexture(GL_TEXTURE0);
+        }
 
-        for (int i = 0, l = drawList.size(); i < l; i++) {
-            drawList[i].chunk->render(shader);
+        // then (with everything that's being drawn in the depth buffer) test every chunk
+        // that's in view, including those that were skipped, so they can come back:
+        if (occlusionQueriesEnabled) {
+            occlusionQueries.begin(camera);
+            for (Chunk* chunk : drawList) {
+                if (chunk->getNumVertices() == 0) { continue; }
+                occlusionQueries.issue(chunk);
+            }
+            occlusionQueries.end();
         }
 
     }
 
+    // GPU occlusion queries (see OcclusionQueries) are off by default:
+    void setOcclusionQueries(bool enabled) {
+        occlusionQueriesEnabled = enabled;
+    }
+    bool getOcclusionQueries() const { return occlusionQueriesEnabled; }
+
+    Executors& getExecutors() {
+        return executors;
+    }
+    const Executors& getExecutors() const {
+        return executors;
+    }
+
+    // for handing GL work back to the main thread (it's run as part of update):
+    GLQueue& getGLQueue() {
+        return glQueue;
+    }
+
+    const ChunkGrid::Generator& getWorldGen() const {
+        return worldGen;
+    }
+
     World(const World&) = delete;
     World& operator=(const World&) = delete;
 
 private:
 
-    struct VisibleChunk {
-        VisibleChunk(Chunk* chunk, int distanceSquared): chunk(chunk), distanceSquared(distanceSquared) {}
-        Chunk* chunk;
-        int distanceSquared;
+    // NB: the order matters here; the grids use worldGen, vertexArena, glQueue and
+    // executors, so need to be destroyed before them (and glQueue does any GL work
+    // left by the grids - including freeing space in vertexArena - as it's destroyed):
+    WorldGen<Chunk::CHUNK_SIZE_X, Chunk::CHUNK_SIZE_Y, Chunk::CHUNK_SIZE_Z> worldGen;
+    VertexArena vertexArena;
+    GLQueue glQueue;
+    Executors executors;
+    struct Level {
+        std::unique_ptr<ChunkGrid> chunks;
+        // the chunks (by their coords in the grid) whose whole area is drawn by the
+        // levels below (see updateCovered):
+        std::unordered_set<std::pair<int, int>, hashPair> covered;
     };
-
-    // in order to use std::unordered_map with std::pair as a key, we need to 
-    // create our own hash function
-    // https://stackoverflow.com/a/20602159/1937302
-    // https://stackoverflow.com/a/27952689/1937302
-    struct hashPair {
-        template <typename T, typename U>
-        std::size_t operator()(const std::pair<T, U> &x) const {
-            std::size_t lhs = std::hash<T>()(x.first);
-            std::size_t rhs = std::hash<U>()(x.second);
-            lhs ^= rhs + 0x9e3779b97f4a7c15 + (lhs << 6) + (lhs >> 2);
-            return lhs;
+    // finest first:
+    std::array<Level, NUM_LEVELS> levels;
+    // works out which full detail chunks are hidden behind (or inside) the terrain:
+    OcclusionCuller occlusionCuller;
+    HorizonCuller horizonCuller;
+    OcclusionQueries occlusionQueries;
+    bool occlusionQueriesEnabled;
+    // the chunks already checked, for updateCovered:
+    std::unordered_set<std::pair<int, int>, hashPair> checked;
+    // what the chunks' draw order (see updateDrawOrder) was worked out for:
+    int drawOrderI = 0, drawOrderJ = 0;
+    std::array<unsigned int, NUM_LEVELS> drawOrderVersions;
+    bool hasDrawOrder = false;
+    // (distance, chunk) for every chunk, for sorting:
+    std::vector<std::pair<int, Chunk*>> orderKeys;
+    // one slot per place in the draw order, holding the chunks that are in view this
+    // frame (and nullptr otherwise):
+    std::vector<Chunk*> drawSlots;
+    std::vector<Chunk*> drawList;
+    // chunks in regions that are only partly in view (and their bounds), which
+    // still need culling individually:
+    std::vector<Chunk*> partialList;
+    AABBArray partialBounds;
+    std::vector<int> visibleIndices;
+    std::vector<GLint> drawFirsts;
+    std::vector<GLsizei> drawCounts;
+
+    // adds the chunk's faces that might face position to drawFirsts/drawCounts. Faces
+    // pointing e.g. left are all at least a block in from the right of the chunk, so if
+    // position's further right than that, they all face away from it. The chunk's faces
+    // are grouped by direction, so whatever's left is drawn as few ranges as possible:
+    void addDrawRanges(const Chunk* chunk, const glm::vec3 &position) {
+
+        const AABB &box = chunk->getAABB();
+        float voxelSize = chunk->getVoxelSize();
+
+        bool canFace[Chunk::NUM_FACES];
+        canFace[Chunk::LEFT] = position.x < box.xMax - voxelSize;
+        canFace[Chunk::RIGHT] = position.x > box.xMin + voxelSize;
+        canFace[Chunk::BOTTOM] = position.y < chunk->getMaxHeight() - voxelSize;
+        canFace[Chunk::TOP] = position.y > box.yMin + voxelSize;
+        canFace[Chunk::BACK] = position.z < box.zMax - voxelSize;
+        canFace[Chunk::FRONT] = position.z > box.zMin + voxelSize;
+
+        bool extending = false;
+        for (int face = 0; face < Chunk::NUM_FACES; face++) {
+            int count = chunk->getNumVertices(static_cast<Chunk::Face>(face));
+            if (!canFace[face]) {
+                extending = false;
+            } else if (count > 0) {
+                if (extending) {
+                    drawCounts.back() += count;
+                } else {
+                    drawFirsts.push_back(chunk->getFirstVertex(static_cast<Chunk::Face>(face)));
+                    drawCounts.push_back(count);
+                    extending = true;
+                }
+            }
         }
-    };
-
-    std::unordered_map<std::pair<int, int>, Chunk*, hashPair> chunks;
-    WorldGen<Chunk::CHUNK_SIZE_X, Chunk::CHUNK_SIZE_Y, Chunk::CHUNK_SIZE_Z> worldGen;
-    std::vector<VisibleChunk> drawList;
-    std::vector<Chunk*> chunkProcessingList;
-    thread_pool threadPool;
-
-    void processChunkList(const std::function<void(Chunk*)> &task) {
-
-        int chunksToProcess = chunkProcessingList.size();
 
-        if (chunksToProcess == 0) { return; }
-
-        int numThreads = threadPool.get_thread_count();
-        int chunksPerTask = std::ceil(chunksToProcess / numThreads);
-        latch tasks_latch(chunksToProcess);
-        int start = 0;
-        int end = 0;
-        while (chunksToProcess > 0) {
-            start = end;
-            end = std::min(start + chunksPerTask, static_cast<int>(chunkProcessingList.size()));
-            chunksToProcess -= chunksPerTask;
-            threadPool.submit([this, start, end, &tasks_latch, &task](){
-
-                for (int i = start; i < end; i++) {
-
-                    task(chunkProcessingList[i]);
+    }
 
-                    tasks_latch.count_down();
+    static int floorDiv(int a, int b) {
+        return (a >= 0 ? a / b : (a - b + 1) / b);
+    }
 
-                }
+    // chunks in regions that are entirely in view can go straight in their slot:
+    void addVisible(Frustum::Overlap regionOverlap, Chunk* chunk) {
 
-            });
+        if (regionOverlap == Frustum::Overlap::INSIDE) {
+            drawSlots[chunk->getDrawOrder()] = chunk;
+        } else {
+            partialList.push_back(chunk);
+            partialBounds.push_back(chunk->getAABB());
         }
-        tasks_latch.wait();
 
     }
 
-    void buildChunks(const glm::vec3 &position) {
+    // sorts every chunk by the distance from the centre of the camera's chunk to the
+    // chunk's centre, and tells each chunk its place. As that only changes when the
+    // camera moves into another chunk (or chunks come and go), it's usually skipped:
+    void updateDrawOrder(const glm::vec3 &position) {
 
         int currentI = std::floor(position.x / Chunk::CHUNK_SIZE_X);
         int currentJ = std::floor(position.z / Chunk::CHUNK_SIZE_Z);
 
-        int minI = currentI - CREATE_RADIUS;
-        int minJ = currentJ - CREATE_RADIUS;
-        int maxI = currentI + 1 + CREATE_RADIUS;
-        int maxJ = currentJ + 1 + CREATE_RADIUS;
-
-        Timer timer{};
-
-        chunkProcessingList.clear();
-
-        // create Chunks within required area:
-        for (int i = minI; i <= maxI; i++) {
-                for (int j = minJ; j <= maxJ; j++) {
-
-                    if (getChunk(i, j) != nullptr) {
-                        // chunk already exists
-                        continue;
-                    }
+        bool unchanged = hasDrawOrder && currentI == drawOrderI && currentJ == drawOrderJ;
+        for (int level = 0; level < NUM_LEVELS; level++) {
+            unchanged = unchanged && levels[level].chunks->getVersion() == drawOrderVersions[level];
+        }
+        if (unchanged) { return; }
 
-                    Chunk* chunk = new Chunk();
-                    chunks.insert({ std::make_pair(i, j), chunk });
-                    chunk->setPosition(glm::ivec3(i * Chunk::CHUNK_SIZE_X, 0, j * Chunk::CHUNK_SIZE_Z ));
-                    chunkProcessingList.push_back(chunk);
+        hasDrawOrder = true;
+        drawOrderI = currentI;
+        drawOrderJ = currentJ;
+        for (int level = 0; level < NUM_LEVELS; level++) {
+            drawOrderVersions[level] = levels[level].chunks->getVersion();
+        }
 
-                }
+        // in half (full detail) chunks, so that centres are whole numbers:
+        int centreX = 2 * currentI + 1;
+        int centreZ = 2 * currentJ + 1;
+
+        orderKeys.clear();
+        for (Level &level : levels) {
+            int voxelSize = level.chunks->getVoxelSize();
+            level.chunks->forEachChunk([&](int i, int j, Chunk* chunk) {
+                int dx = voxelSize * (2 * i + 1) - centreX;
+                int dz = voxelSize * (2 * j + 1) - centreZ;
+                orderKeys.emplace_back(dx * dx + dz * dz, chunk);
+            });
         }
 
-        processChunkList([this](Chunk* chunk) {
-            chunk->generateBlocks(worldGen);
+        std::sort(orderKeys.begin(), orderKeys.end(), [](const std::pair<int, Chunk*> &a, const std::pair<int, Chunk*> &b) {
+            return a.first < b.first;
         });
 
-        chunkProcessingList.clear();
-
-        timer.printTime("world gen");
-        timer.reset();
-
-        // make sure all chunks within draw radius have a mesh:
-        for (auto const& [key, chunk] : chunks) {
-
-            if (chunk->getStatus() == Chunk::Status::COMPLETE) {
-                // chunk already has a mesh
-                continue;
-            }
-
-            if (key.first > minI && key.first < maxI &&
-                key.second > minJ && key.second < maxJ) {
-
-                    chunkProcessingList.push_back(chunk);
-
-            }
-
+        for (int i = 0, l = orderKeys.size(); i < l; i++) {
+            orderKeys[i].second->setDrawOrder(i);
         }
+        drawSlots.assign(orderKeys.size(), nullptr);
 
-        processChunkList([this](Chunk* chunk) {
-
-            const glm::ivec3& chunkPos = chunk->getPosition();
-            int chunkI = chunkPos.x / Chunk::CHUNK_SIZE_X;
-            int chunkJ = chunkPos.z / Chunk::CHUNK_SIZE_Z;
-
-            Chunk::Neighbourhood neighbourhood {
-                getChunk(chunkI - 1, chunkJ), // left
-                getChunk(chunkI + 1, chunkJ), // right
-                nullptr, // top
-                nullptr, // bottom
-                getChunk(chunkI, chunkJ + 1), // front
-                getChunk(chunkI, chunkJ - 1)  // back
-            };
-            chunk->generateMesh(neighbourhood);
+    }
 
-        });
+    bool isCovered(int level, int i, int j) const {
+        return level > 0 && levels[level].covered.count(std::make_pair(i, j)) > 0;
+    }
 
-        // pushing meshes to the GPU seems to need doing on the main thread:
-        // TODO: look into multi-threading and OpenGL a bit more!!
-        int chunksToProcess = chunkProcessingList.size();
-        for (int i = 0; i < chunksToProcess; i++) {
-            chunkProcessingList[i]->syncMesh();
-        }
+    // whether the chunk's whole area is drawn, whether by it or the levels below:
+    bool isFilled(int level, int i, int j) const {
 
-        timer.printTime("meshes built");
+        Chunk* chunk = levels[level].chunks->getChunk(i, j);
+        return (chunk != nullptr && chunk->getStatus() == Chunk::Status::COMPLETE) || isCovered(level, i, j);
 
     }
 
-    void freeChunks(const glm::vec3 &position) {
+    // works out, level by level going up, which chunks are covered: those whose children
+    // are all filled. Only chunks above ones in the level below need checking.
+    // NB: chunks get their meshes within their grid's draw radius, but aren't freed until
+    // a couple of chunks further out (see ChunkGrid), and they count until then. So where
+    // one level gives way to the next trails behind the camera a little, rather than
+    // flicking back and forth as it goes back and forth over a chunk boundary:
+    void updateCovered() {
 
-        int currentI = std::floor(position.x / Chunk::CHUNK_SIZE_X);
-        int currentJ = std::floor(position.z / Chunk::CHUNK_SIZE_Z);
+        for (int level = 1; level < NUM_LEVELS; level++) {
 
-        int minI = currentI - OUTER_RADIUS;
-        int minJ = currentJ - OUTER_RADIUS;
-        int maxI = currentI + 1 + OUTER_RADIUS;
-        int maxJ = currentJ + 1 + OUTER_RADIUS;
+            std::unordered_set<std::pair<int, int>, hashPair> &covered = levels[level].covered;
+            covered.clear();
+            checked.clear();
 
-        for (auto it = chunks.cbegin(); it != chunks.cend(); ) {
-
-            std::pair<int, int> key = it->first;
-            
-            if (key.first >= minI && key.first <= maxI &&
-                key.second >= minJ && key.second <= maxJ) {
-                
-                    ++it;
-                    continue;
-            }
+            levels[level - 1].chunks->forEachChunk([&](int childI, int childJ, Chunk*) {
 
-            Chunk* chunk = it->second;
-            it = chunks.erase(it);
-            delete chunk;
+                int i = floorDiv(childI, LEVEL_RATIO);
+                int j = floorDiv(childJ, LEVEL_RATIO);
+                if (!checked.insert(std::make_pair(i, j)).second) { return; }
 
-        }
+                for (int x = i * LEVEL_RATIO; x < (i + 1) * LEVEL_RATIO; x++) {
+                    for (int z = j * LEVEL_RATIO; z < (j + 1) * LEVEL_RATIO; z++) {
+                        if (!isFilled(level - 1, x, z)) { return; }
+                    }
+                }
 
-    }
+                covered.insert(std::make_pair(i, j));
 
-    Chunk* getChunk(int i, int j) const {
+            });
 
-        auto search = chunks.find(std::make_pair(i, j));
-        if (search == chunks.end()) {
-            return nullptr;
         }
-        return search->second;
 
     }
 
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../libs/multi-threading/pool-stats.h"
+
+// writes a line of thread pool stats per frame to a CSV file, next to the frame's time,
+// so that slow frames can be lined up against what the pools were doing at the time.
+// Each pool's columns are prefixed with its name.
+// NB: stats are logged as the change since the last call, so for a row's numbers to
+// belong to its frame, each call's stats want taking at the same point in the frame
+// as frameTime is measured up to (i.e. frameTime should be the time since the last call)
+// NB: the pool only collects most of these when built with THREAD_POOL_STATS
+class PoolStatsLog {
+
+public:
+    PoolStatsLog(const std::string &path, const std::vector<std::string> &poolNames, const std::vector<thread_pool_stats> &initialStats)
+        : out(path), previous(initialStats) {
+
+        out << "frame,frame_ms";
+        for (int p = 0, l = poolNames.size(); p < l; p++) {
+            const std::string &name = poolNames[p];
+            out << "," << name << "_submitted," << name << "_completed," << name << "_queue_depth,"
+                << name << "_wait_p50_us," << name << "_wait_p99_us," << name << "_exec_p50_us," << name << "_exec_p99_us";
+            for (int i = 0, numWorkers = initialStats[p].worker_busy_time.size(); i < numWorkers; i++) {
+                out << "," << name << "_busy_" << i;
+            }
+        }
+        out << "\n";
+
+    }
+
+    void frame(double frameTime, const std::vector<thread_pool_stats> &stats) {
+
+        out << frameCount++ << "," << frameTime * 1000.0;
+
+        for (int p = 0, l = stats.size(); p < l; p++) {
+
+            thread_pool_stats delta = stats[p].since(previous[p]);
+
+            out << "," << delta.submitted << "," << delta.completed << "," << delta.queue_depth << ","
+                << delta.wait_times.quantile(0.5) << "," << delta.wait_times.quantile(0.99) << ","
+                << delta.exec_times.quantile(0.5) << "," << delta.exec_times.quantile(0.99);
+            for (int i = 0, numWorkers = delta.worker_busy_time.size(); i < numWorkers; i++) {
+                out << "," << delta.busy_ratio(i);
+            }
+
+        }
+        out << "\n";
+
+        previous = stats;
+
+    }
+
+private:
+    std::ofstream out;
+    std::vector<thread_pool_stats> previous;
+    int frameCount = 0;
+
+};
@@ -1,6 +1,9 @@
 
 #pragma once
 
+#include <vector>
+#include <cstddef>
+
 // axis-aligned bounding box:
 struct AABB {
     
@@ -37,3 +40,46 @@ struct AABB {
     }
 
 };
+
+// a list of boxes, stored as one array per component (rather than an array of AABBs),
+// so that several can be tested at once with SIMD (see Frustum::cull):
+struct AABBArray {
+
+    std::vector<float> xMin, xMax, yMin, yMax, zMin, zMax;
+
+    void push_back(const AABB &box) {
+
+        xMin.push_back(box.xMin);
+        xMax.push_back(box.xMax);
+        yMin.push_back(box.yMin);
+        yMax.push_back(box.yMax);
+        zMin.push_back(box.zMin);
+        zMax.push_back(box.zMax);
+
+    }
+
+    void clear() {
+
+        xMin.clear();
+        xMax.clear();
+        yMin.clear();
+        yMax.clear();
+        zMin.clear();
+        zMax.clear();
+
+    }
+
+    void reserve(std::size_t capacity) {
+
+        xMin.reserve(capacity);
+        xMax.reserve(capacity);
+        yMin.reserve(capacity);
+        yMax.reserve(capacity);
+        zMin.reserve(capacity);
+        zMax.reserve(capacity);
+
+    }
+
+    int size() const { return xMin.size(); }
+
+};
@@ -11,6 +11,7 @@
 
 #include "./window.h"
 #include "./aabb.h"
+#include "./frustum.h"
 
 // a typical FPS Camera (i.e. there's no roll)
 class Camera {
@@ -21,12 +22,17 @@ public:
                 GLfloat initialMovementSpeed, GLfloat initialTurnSpeed, GLfloat initialFovYAngle,
                 GLfloat initialAspectRatio, GLfloat initialNearPlaneDistance, GLfloat initialFarPlaneDistance);
 
-    glm::mat4 calcualateViewMatrix();
-    glm::mat4 calcualateProjectionMatrix();
+    glm::mat4 calcualateViewMatrix() const;
+    glm::mat4 calcualateProjectionMatrix() const;
+    // the same projection, but with a different depth range (e.g. for things that are
+    // further away than the far plane):
+    glm::mat4 calcualateProjectionMatrix(GLfloat near, GLfloat far) const;
 
     void update(double deltaTime, Window &window);
 
     bool canSee(const AABB &box) const;
+    // for testing lots of boxes at once:
+    const Frustum& getFrustum() const { return frustum; };
 
     const glm::vec3& getPosition() const { return position; };
     const glm::vec3& getDirection() const { return front; };
@@ -59,10 +65,10 @@ private:
     GLfloat aspectRatio;
     GLfloat nearPlaneDistance;
     GLfloat farPlaneDistance;
-    AABB frustrumAABB;
+    Frustum frustum;
 
     void updateDirectionVectors();
-    void updateFrustrumAABB();
+    void updateFrustum();
 
 };
 
@@ -75,11 +81,11 @@ Camera::Camera(glm::vec3 initialPosition, GLfloat initialYaw, GLfloat initialPit
         farPlaneDistance(initialFarPlaneDistance) {
 
             updateDirectionVectors();
-            updateFrustrumAABB();
+            updateFrustum();
 
         }
 
-glm::mat4 Camera::calcualateViewMatrix() {
+glm::mat4 Camera::calcualateViewMatrix() const {
     // NB: in documentation/tutorials, there's seems to be some confusion about 
     // whether the third argument to lookAt should be the camera's up or the 
     // world's up. However - after looking at the glm::lookAt source code - in 
@@ -88,10 +94,14 @@ glm::mat4 Camera::calcualateViewMatrix() {
     return glm::lookAt(position, position + front, up);
 }
 
-glm::mat4 Camera::calcualateProjectionMatrix() {
+glm::mat4 Camera::calcualateProjectionMatrix() const {
     return glm::perspective(fovYAngle, aspectRatio, nearPlaneDistance, farPlaneDistance);
 }
 
+glm::mat4 Camera::calcualateProjectionMatrix(GLfloat near, GLfloat far) const {
+    return glm::perspective(fovYAngle, aspectRatio, near, far);
+}
+
 void Camera::updateDirectionVectors() {
 
     front.x = cos(yaw) * cos(pitch);
@@ -105,36 +115,11 @@ void Camera::updateDirectionVectors() {
 
 }
 
-void Camera::updateFrustrumAABB() {
-
-    frustrumAABB.xMin = position.x;
-    frustrumAABB.xMax = position.x;
-    frustrumAABB.yMin = position.y;
-    frustrumAABB.yMax = position.y;
-    frustrumAABB.zMin = position.z;
-    frustrumAABB.zMax = position.z;
-
-    GLfloat farFaceHalfHeight = farPlaneDistance * tan(fovYAngle);
-    glm::vec3 farFaceHalfUp = farFaceHalfHeight * up;
-    glm::vec3 farFaceHalfRight = farFaceHalfHeight * aspectRatio * right;
-    glm::vec3 farFaceCentre = position + farPlaneDistance * front;
-
-    // iterate over the four corners of the far face of the view frustrum, and 
-    // expand the frustrumAABB to include them:
-    for (int i = -1; i <= 1; i += 2) {
-        for (int j = -1; j <= 1; j += 2) {
+// NB: the planes come from the same matrices used for drawing, so the frustum always
+// matches what's on screen:
+void Camera::updateFrustum() {
 
-            glm::vec3 corner = farFaceCentre + static_cast<float>(i) * farFaceHalfUp + static_cast<float>(j) * farFaceHalfRight;
-
-            frustrumAABB.xMin = std::min(frustrumAABB.xMin, corner.x);
-            frustrumAABB.xMax = std::max(frustrumAABB.xMax, corner.x);
-            frustrumAABB.yMin = std::min(frustrumAABB.yMin, corner.y);
-            frustrumAABB.yMax = std::max(frustrumAABB.yMax, corner.y);
-            frustrumAABB.zMin = std::min(frustrumAABB.zMin, corner.z);
-            frustrumAABB.zMax = std::max(frustrumAABB.zMax, corner.z);
-
-        }
-    }
+    frustum = Frustum(calcualateProjectionMatrix() * calcualateViewMatrix());
 
 }
 
@@ -187,13 +172,12 @@ void Camera::update(double deltaTime, Window &window) {
     }
 
     updateDirectionVectors();
-    updateFrustrumAABB();
+    updateFrustum();
 
 }
 
 bool Camera::canSee(const AABB &box) const {
 
-    // TODO: use SAT for tighter frustum/box intersection
-    return frustrumAABB.intersects(box);
+    return frustum.intersects(box);
 
 }
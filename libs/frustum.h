@@ -0,0 +1,163 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "./aabb.h"
+
+// the six planes of a view frustum, pulled straight out of a combined projection * view
+// matrix (the Gribb/Hartmann method), so they always match what's actually drawn.
+//
+// boxes are tested against each plane using the box's corner furthest along the plane's
+// normal: if that corner is behind any plane, the box is outside. This is conservative -
+// a big box just beyond a corner of the frustum can be let through - but it never drops
+// anything that's visible.
+class Frustum {
+
+public:
+
+    enum class Overlap { OUTSIDE, INTERSECTING, INSIDE };
+
+    Frustum() = default;
+
+    explicit Frustum(const glm::mat4 &viewProjection) {
+
+        // NB: glm is column major, so m[col][row]:
+        const glm::mat4 &m = viewProjection;
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        planes[LEFT] = row3 + row0;
+        planes[RIGHT] = row3 - row0;
+        planes[BOTTOM] = row3 + row1;
+        planes[TOP] = row3 - row1;
+        planes[NEAR] = row3 + row2;
+        planes[FAR] = row3 - row2;
+
+        // normalise, so that plane distances are in world units:
+        for (glm::vec4 &plane : planes) {
+            plane = plane * (1.0f / glm::length(glm::vec3(plane.x, plane.y, plane.z)));
+        }
+
+    }
+
+    bool intersects(const AABB &box) const {
+
+        for (const glm::vec4 &plane : planes) {
+            float x = (plane.x > 0 ? box.xMax : box.xMin);
+            float y = (plane.y > 0 ? box.yMax : box.yMin);
+            float z = (plane.z > 0 ? box.zMax : box.zMin);
+            if (plane.x * x + plane.y * y + plane.z * z + plane.w < 0) {
+                return false;
+            }
+        }
+
+        return true;
+
+    }
+
+    // like intersects, but also tells whether the box is entirely inside (i.e. its corner
+    // nearest each plane is in front of it too), so everything in it is visible without
+    // testing it separately:
+    Overlap classify(const AABB &box) const {
+
+        Overlap overlap = Overlap::INSIDE;
+
+        for (const glm::vec4 &plane : planes) {
+
+            float x = (plane.x > 0 ? box.xMax : box.xMin);
+            float y = (plane.y > 0 ? box.yMax : box.yMin);
+            float z = (plane.z > 0 ? box.zMax : box.zMin);
+            if (plane.x * x + plane.y * y + plane.z * z + plane.w < 0) {
+                return Overlap::OUTSIDE;
+            }
+
+            x = (plane.x > 0 ? box.xMin : box.xMax);
+            y = (plane.y > 0 ? box.yMin : box.yMax);
+            z = (plane.z > 0 ? box.zMin : box.zMax);
+            if (plane.x * x + plane.y * y + plane.z * z + plane.w < 0) {
+                overlap = Overlap::INTERSECTING;
+            }
+
+        }
+
+        return overlap;
+
+    }
+
+    // appends the index of every box in boxes that intersects the frustum to visible
+    // (in order). With SSE, boxes are tested four at a time:
+    void cull(const AABBArray &boxes, std::vector<int> &visible) const {
+
+        int numBoxes = boxes.size();
+        int i = 0;
+
+#if defined(__SSE__)
+        // which corner to use (and so which arrays to read from) only depends on the plane,
+        // so that - and the plane itself, spread across all four lanes - is worked out once:
+        const float* xs[NUM_PLANES];
+        const float* ys[NUM_PLANES];
+        const float* zs[NUM_PLANES];
+        __m128 a[NUM_PLANES], b[NUM_PLANES], c[NUM_PLANES], d[NUM_PLANES];
+        for (int p = 0; p < NUM_PLANES; p++) {
+            xs[p] = (planes[p].x > 0 ? boxes.xMax : boxes.xMin).data();
+            ys[p] = (planes[p].y > 0 ? boxes.yMax : boxes.yMin).data();
+            zs[p] = (planes[p].z > 0 ? boxes.zMax : boxes.zMin).data();
+            a[p] = _mm_set1_ps(planes[p].x);
+            b[p] = _mm_set1_ps(planes[p].y);
+            c[p] = _mm_set1_ps(planes[p].z);
+            d[p] = _mm_set1_ps(planes[p].w);
+        }
+
+        for (; i + 4 <= numBoxes; i += 4) {
+
+            __m128 outside = _mm_setzero_ps();
+
+            for (int p = 0; p < NUM_PLANES; p++) {
+                __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(xs[p] + i), a[p]), _mm_mul_ps(_mm_loadu_ps(ys[p] + i), b[p])),
+                    _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(zs[p] + i), c[p]), d[p]));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+            }
+
+            int outsideMask = _mm_movemask_ps(outside);
+            if (outsideMask == 0xF) { continue; }
+            for (int j = 0; j < 4; j++) {
+                if (!(outsideMask & (1 << j))) {
+                    visible.push_back(i + j);
+                }
+            }
+
+        }
+#endif
+
+        // whatever's left over (or everything, without SSE):
+        for (; i < numBoxes; i++) {
+            AABB box = {
+                boxes.xMin[i], boxes.xMax[i],
+                boxes.yMin[i], boxes.yMax[i],
+                boxes.zMin[i], boxes.zMax[i]
+            };
+            if (intersects(box)) {
+                visible.push_back(i);
+            }
+        }
+
+    }
+
+private:
+
+    enum Plane { LEFT, RIGHT, BOTTOM, TOP, NEAR, FAR, NUM_PLANES };
+
+    // (a, b, c, d) for the plane ax + by + cz + d = 0, with (a, b, c) pointing inwards:
+    glm::vec4 planes[NUM_PLANES];
+
+};
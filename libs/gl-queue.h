@@ -0,0 +1,194 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <coroutine>
+#include <utility>
+
+#include <glad/glad.h>
+
+#include "./multi-threading/function-wrapper.h"
+
+// GL calls have to be made on the thread that owns the context (i.e. the main thread).
+// GLQueue lets other threads hand GL work to the main thread: jobs (uploads, VAO setup etc)
+// can be posted, coroutines can co_await schedule() to carry on on the main thread, and GL
+// objects can be queued for deletion (so whatever owns them can be destroyed anywhere).
+//
+// The main thread calls run once per frame with a time budget, so a burst of uploads
+// is spread over several frames rather than causing one long one. Deletes are cheap,
+// so they're always done in full.
+// NB: everything other than run/runAll can be called from any thread
+class GLQueue {
+
+public:
+
+    // NB: must be constructed on the main thread
+    GLQueue(): mainThreadId(std::this_thread::get_id()) {}
+
+    // NB: must be destroyed on the main thread (with the context still current)
+    ~GLQueue() {
+
+        runAll();
+
+    }
+
+    template <typename F>
+    void post(F&& job) {
+
+        std::lock_guard lock(queueMutex);
+        jobs.emplace_back(std::forward<F>(job));
+
+    }
+
+    // NB: a coroutine that's already on the main thread just carries on
+    auto schedule() {
+
+        struct Awaiter {
+            GLQueue &queue;
+            bool await_ready() const noexcept { return queue.isMainThread(); }
+            void await_suspend(std::coroutine_handle<> handle) {
+                queue.post([handle]() { handle.resume(); });
+            }
+            void await_resume() const noexcept {}
+        };
+
+        return Awaiter{ *this };
+
+    }
+
+    bool isMainThread() const {
+        return std::this_thread::get_id() == mainThreadId;
+    }
+
+    void deleteBuffer(GLuint buffer) {
+
+        std::lock_guard lock(queueMutex);
+        buffersToDelete.push_back(buffer);
+
+    }
+
+    void deleteVertexArray(GLuint vertexArray) {
+
+        std::lock_guard lock(queueMutex);
+        vertexArraysToDelete.push_back(vertexArray);
+
+    }
+
+    void deleteQuery(GLuint query) {
+
+        std::lock_guard lock(queueMutex);
+        queriesToDelete.push_back(query);
+
+    }
+
+    // runs jobs until budget is used up. At least one job is always run (if there
+    // is one), so that progress is made however small the budget. Jobs posted whilst
+    // running (including by the jobs themselves) are left for the next call.
+    // returns whether anything was done
+    // NB: must be called from the main thread
+    bool run(std::chrono::microseconds budget) {
+
+        return process(true, budget);
+
+    }
+
+    // runs everything, regardless of how long it takes:
+    // NB: must be called from the main thread
+    bool runAll() {
+
+        return process(false, std::chrono::microseconds(0));
+
+    }
+
+    GLQueue(const GLQueue&) = delete;
+    GLQueue& operator=(const GLQueue&) = delete;
+
+private:
+
+    const std::thread::id mainThreadId;
+    std::mutex queueMutex;
+    std::deque<function_wrapper> jobs;
+    std::vector<GLuint> buffersToDelete;
+    std::vector<GLuint> vertexArraysToDelete;
+    std::vector<GLuint> queriesToDelete;
+    // only touched by the main thread:
+    std::vector<GLuint> deleting;
+
+    bool process(bool useBudget, std::chrono::microseconds budget) {
+
+        auto start = std::chrono::steady_clock::now();
+
+        bool didSomething = deletePending();
+
+        std::size_t numJobs;
+        {
+            std::lock_guard lock(queueMutex);
+            numJobs = jobs.size();
+        }
+
+        for (std::size_t i = 0; i < numJobs; i++) {
+
+            if (useBudget && i > 0 && std::chrono::steady_clock::now() - start > budget) {
+                break;
+            }
+
+            function_wrapper job;
+            {
+                std::lock_guard lock(queueMutex);
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+            didSomething = true;
+
+        }
+
+        // whatever the jobs freed:
+        deletePending();
+
+        return didSomething;
+
+    }
+
+    bool deletePending() {
+
+        bool didSomething = false;
+
+        deleting.clear();
+        {
+            std::lock_guard lock(queueMutex);
+            deleting.swap(vertexArraysToDelete);
+        }
+        if (!deleting.empty()) {
+            glDeleteVertexArrays(deleting.size(), &deleting[0]);
+            didSomething = true;
+        }
+
+        deleting.clear();
+        {
+            std::lock_guard lock(queueMutex);
+            deleting.swap(buffersToDelete);
+        }
+        if (!deleting.empty()) {
+            glDeleteBuffers(deleting.size(), &deleting[0]);
+            didSomething = true;
+        }
+
+        deleting.clear();
+        {
+            std::lock_guard lock(queueMutex);
+            deleting.swap(queriesToDelete);
+        }
+        if (!deleting.empty()) {
+            glDeleteQueries(deleting.size(), &deleting[0]);
+            didSomething = true;
+        }
+
+        return didSomething;
+
+    }
+
+};
@@ -0,0 +1,120 @@
+// building blocks for writing multi-stage jobs as C++20 coroutines on top of thread_pools:
+//
+// fire_and_forget - the return type for a coroutine that nobody waits on. It starts
+// running straight away on the calling thread, and its frame is freed when it finishes.
+// As with thread_pool::submit, an exception escaping it calls std::terminate.
+//
+// resume_on(pool) - co_await this to carry on running on one of pool's threads (if
+// it's already on one, it just carries on). To carry on on the main thread instead
+// (e.g. for GL work), co_await GLQueue::schedule() - see gl-queue.h.
+//
+// async_event - a one-shot flag that coroutines can co_await via wait_on(pool). Once it's
+// set, waiters are resumed on the pool they asked for, so nothing ever blocks a thread
+// whilst waiting. (If it's already set, it's the same as resume_on(pool).)
+//
+// NB: a suspended coroutine that's never resumed leaks its frame, so anything that can
+// park coroutines indefinitely needs a way of waking them to cancel (see ChunkGrid)
+
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <vector>
+#include <utility>
+
+#include "./thread-pool.h"
+
+struct fire_and_forget {
+
+    struct promise_type {
+        fire_and_forget get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+};
+
+inline auto resume_on(thread_pool &pool) {
+
+    struct awaiter {
+        thread_pool &pool;
+        bool await_ready() const noexcept { return pool.is_worker_thread(); }
+        void await_suspend(std::coroutine_handle<> handle) {
+            pool.submit([handle]() { handle.resume(); });
+        }
+        void await_resume() const noexcept {}
+    };
+
+    return awaiter{ pool };
+
+}
+
+class async_event {
+
+public:
+
+    async_event(): is_set_flag(false) {}
+
+    // resumes everything waiting on the event:
+    void set() {
+
+        std::vector<waiter> to_resume;
+        {
+            std::lock_guard lock(event_mutex);
+            if (is_set_flag) { return; }
+            is_set_flag = true;
+            to_resume.swap(waiters);
+        }
+
+        for (waiter &w : to_resume) {
+            w.pool->submit([handle = w.handle]() { handle.resume(); });
+        }
+
+    }
+
+    auto wait_on(thread_pool &pool) {
+
+        struct awaiter {
+            async_event &event;
+            thread_pool &pool;
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> handle) {
+                {
+                    std::lock_guard lock(event.event_mutex);
+                    if (!event.is_set_flag) {
+                        event.waiters.push_back({ handle, &pool });
+                        return true;
+                    }
+                }
+                // already set, so just make sure we're on the right pool:
+                if (pool.is_worker_thread()) {
+                    return false;
+                }
+                pool.submit([handle]() { handle.resume(); });
+                return true;
+            }
+            void await_resume() const noexcept {}
+        };
+
+        return awaiter{ *this, pool };
+
+    }
+
+    async_event(const async_event&) = delete;
+    async_event& operator=(const async_event&) = delete;
+
+private:
+
+    struct waiter {
+        std::coroutine_handle<> handle;
+        thread_pool* pool;
+    };
+
+    std::mutex event_mutex;
+    bool is_set_flag;
+    std::vector<waiter> waiters;
+
+};
@@ -0,0 +1,127 @@
+// a move-only, type-erased wrapper for a callable taking no arguments and returning
+// nothing (i.e. a std::function<void()> that can hold move-only callables). Callables
+// that fit in INLINE_SIZE bytes are stored inline, so wrapping a typical lambda (that
+// captures a handful of pointers/references) doesn't allocate.
+
+#pragma once
+
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+
+class function_wrapper {
+
+public:
+
+    static constexpr std::size_t INLINE_SIZE = 48;
+
+    function_wrapper(): ops(nullptr) {}
+
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, function_wrapper>>>
+    function_wrapper(F&& f) {
+
+        using T = std::decay_t<F>;
+
+        if constexpr (fits_inline<T>()) {
+            new (&storage) T(std::forward<F>(f));
+            ops = &inline_ops<T>;
+        } else {
+            heap_pointer() = new T(std::forward<F>(f));
+            ops = &heap_ops<T>;
+        }
+
+    }
+
+    function_wrapper(function_wrapper&& other): ops(other.ops) {
+
+        if (ops) {
+            ops->move(&other.storage, &storage);
+            other.ops = nullptr;
+        }
+
+    }
+
+    function_wrapper& operator=(function_wrapper&& other) {
+
+        if (this != &other) {
+            reset();
+            ops = other.ops;
+            if (ops) {
+                ops->move(&other.storage, &storage);
+                other.ops = nullptr;
+            }
+        }
+        return *this;
+
+    }
+
+    ~function_wrapper() {
+
+        reset();
+
+    }
+
+    void operator()() {
+
+        ops->invoke(&storage);
+
+    }
+
+    explicit operator bool() const {
+        return ops != nullptr;
+    }
+
+    function_wrapper(const function_wrapper&) = delete;
+    function_wrapper& operator=(const function_wrapper&) = delete;
+
+private:
+
+    // a hand-rolled vtable, so that there's only one pointer per wrapper:
+    struct operations {
+        void (*invoke)(void* storage);
+        // move constructs into to from from, and destroys from:
+        void (*move)(void* from, void* to);
+        void (*destroy)(void* storage);
+    };
+
+    std::aligned_storage_t<INLINE_SIZE, alignof(std::max_align_t)> storage;
+    const operations* ops;
+
+    template <typename T>
+    static constexpr bool fits_inline() {
+        return sizeof(T) <= INLINE_SIZE && alignof(std::max_align_t) % alignof(T) == 0 &&
+            std::is_nothrow_move_constructible_v<T>;
+    }
+
+    void*& heap_pointer() {
+        return *reinterpret_cast<void**>(&storage);
+    }
+
+    void reset() {
+
+        if (ops) {
+            ops->destroy(&storage);
+            ops = nullptr;
+        }
+
+    }
+
+    template <typename T>
+    static constexpr operations inline_ops = {
+        [](void* storage) { (*static_cast<T*>(storage))(); },
+        [](void* from, void* to) {
+            new (to) T(std::move(*static_cast<T*>(from)));
+            static_cast<T*>(from)->~T();
+        },
+        [](void* storage) { static_cast<T*>(storage)->~T(); }
+    };
+
+    template <typename T>
+    static constexpr operations heap_ops = {
+        [](void* storage) { (**static_cast<T**>(storage))(); },
+        [](void* from, void* to) { *static_cast<T**>(to) = *static_cast<T**>(from); },
+        [](void* storage) { delete *static_cast<T**>(storage); }
+    };
+
+};
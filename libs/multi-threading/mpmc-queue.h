@@ -0,0 +1,138 @@
+// a bounded, lock-free, multi-producer multi-consumer queue - based on Dmitry Vyukov's
+// bounded MPMC queue: http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+// Each slot carries a sequence number which says whether it's ready to be written to or
+// read from on the current lap of the ring, so producers and consumers only contend on
+// their own position counter (plus the slot itself). Slots and counters are padded out to
+// cache lines to avoid false sharing. All the memory is allocated up front, so pushing
+// and popping never allocate; when the queue is full, try_push fails and it's up to
+// the producer to decide what to do (i.e. backpressure).
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+template <typename T>
+class mpmc_queue {
+
+public:
+
+    // NB: capacity is rounded up to a power of two
+    mpmc_queue(std::size_t capacity = 4096): buffer(round_up_capacity(capacity)), mask(buffer.size() - 1),
+        enqueue_position(0), dequeue_position(0) {
+
+        for (std::size_t i = 0; i < buffer.size(); i++) {
+            buffer[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+    }
+
+    // moves from value only if there was room (and so returns true):
+    bool try_push(T &value) {
+
+        slot* target;
+        std::size_t position = enqueue_position.load(std::memory_order_relaxed);
+
+        while (true) {
+
+            target = &buffer[position & mask];
+            std::size_t sequence = target->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+
+            if (difference == 0) {
+                // the slot is free on this lap - try to claim it:
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                // the slot still holds an item from the previous lap, so we're full:
+                return false;
+            } else {
+                // another producer got here first:
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+
+        }
+
+        target->data = std::move(value);
+        target->sequence.store(position + 1, std::memory_order_release);
+        return true;
+
+    }
+
+    bool try_pop(T &return_value) {
+
+        slot* target;
+        std::size_t position = dequeue_position.load(std::memory_order_relaxed);
+
+        while (true) {
+
+            target = &buffer[position & mask];
+            std::size_t sequence = target->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+
+            if (difference == 0) {
+                if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                // nothing has been written to the slot yet, so we're empty:
+                return false;
+            } else {
+                position = dequeue_position.load(std::memory_order_relaxed);
+            }
+
+        }
+
+        return_value = std::move(target->data);
+        // mark the slot as free for the next lap:
+        target->sequence.store(position + mask + 1, std::memory_order_release);
+        return true;
+
+    }
+
+    std::size_t capacity() const {
+        return buffer.size();
+    }
+
+    // NB: only a snapshot - it may well be out of date by the time it's used
+    std::size_t size_approx() const {
+
+        std::size_t enqueued = enqueue_position.load(std::memory_order_relaxed);
+        std::size_t dequeued = dequeue_position.load(std::memory_order_relaxed);
+        return (enqueued > dequeued ? enqueued - dequeued : 0);
+
+    }
+
+    mpmc_queue(const mpmc_queue&) = delete;
+    mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+private:
+
+    static constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+    struct alignas(CACHE_LINE_SIZE) slot {
+        std::atomic<std::size_t> sequence;
+        T data;
+    };
+
+    std::vector<slot> buffer;
+    const std::size_t mask;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> enqueue_position;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> dequeue_position;
+    // keep whatever follows off dequeue_position's cache line:
+    char padding[CACHE_LINE_SIZE - sizeof(std::atomic<std::size_t>)];
+
+    static std::size_t round_up_capacity(std::size_t capacity) {
+
+        std::size_t result = 2;
+        while (result < capacity) {
+            result <<= 1;
+        }
+        return result;
+
+    }
+
+};
@@ -0,0 +1,172 @@
+// counters for seeing what a thread_pool is up to: tasks submitted/completed, queue depth,
+// how long tasks sit in a queue before they start, how long they take to run, and how
+// much of the time each worker spends running tasks.
+// NB: these are only collected when THREAD_POOL_STATS is defined. Otherwise thread_pool
+// doesn't keep any counters at all, and get_stats() just reports the queue depth
+
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+
+// counts durations in power of two buckets of microseconds: bucket 0 is under 1us,
+// bucket i is [2^(i-1), 2^i) us, and the last bucket catches everything longer:
+struct duration_histogram {
+
+    static constexpr int NUM_BUCKETS = 24;
+
+    std::array<std::uint64_t, NUM_BUCKETS> counts{};
+
+    static int bucket_for(std::chrono::nanoseconds duration) {
+
+        std::int64_t micros = duration.count() / 1000;
+        int bucket = 0;
+        while (micros > 0 && bucket < NUM_BUCKETS - 1) {
+            micros >>= 1;
+            bucket++;
+        }
+        return bucket;
+
+    }
+
+    std::uint64_t total() const {
+
+        std::uint64_t result = 0;
+        for (std::uint64_t count : counts) {
+            result += count;
+        }
+        return result;
+
+    }
+
+    // an upper bound (in microseconds) on the p-th quantile (p in [0, 1]):
+    double quantile(double p) const {
+
+        std::uint64_t target = p * total();
+        std::uint64_t seen = 0;
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            seen += counts[i];
+            if (seen > target) {
+                return (1 << i);
+            }
+        }
+        return 0.0;
+
+    }
+
+};
+
+// a snapshot of a pool's counters. Counts and times are totals since the pool started,
+// so take the difference between two snapshots (via since) to get figures for a frame:
+struct thread_pool_stats {
+
+    // the period the figures cover:
+    std::chrono::steady_clock::time_point taken_at;
+    std::chrono::nanoseconds interval{0};
+
+    std::uint64_t submitted = 0;
+    std::uint64_t completed = 0;
+    // tasks sitting in queues when the snapshot was taken:
+    int queue_depth = 0;
+
+    duration_histogram wait_times;
+    duration_histogram exec_times;
+
+    // time each worker has spent running tasks:
+    std::vector<std::chrono::nanoseconds> worker_busy_time;
+
+    thread_pool_stats since(const thread_pool_stats &earlier) const {
+
+        thread_pool_stats result = *this;
+        result.interval = taken_at - earlier.taken_at;
+        result.submitted -= earlier.submitted;
+        result.completed -= earlier.completed;
+
+        for (int i = 0; i < duration_histogram::NUM_BUCKETS; i++) {
+            result.wait_times.counts[i] -= earlier.wait_times.counts[i];
+            result.exec_times.counts[i] -= earlier.exec_times.counts[i];
+        }
+
+        for (std::size_t i = 0; i < result.worker_busy_time.size() && i < earlier.worker_busy_time.size(); i++) {
+            result.worker_busy_time[i] -= earlier.worker_busy_time[i];
+        }
+
+        return result;
+
+    }
+
+    // fraction of the interval that worker spent running tasks (the rest it was idle):
+    double busy_ratio(int worker) const {
+
+        if (interval.count() <= 0) { return 0.0; }
+        return static_cast<double>(worker_busy_time[worker].count()) / interval.count();
+
+    }
+
+};
+
+// the live counters behind thread_pool_stats. Everything is relaxed atomics - the
+// figures only need to be roughly consistent with each other:
+class thread_pool_counters {
+
+public:
+
+    thread_pool_counters(int num_workers)
+        : start(std::chrono::steady_clock::now()), num_workers(num_workers), workers(new worker_counters[num_workers]) {}
+
+    void task_submitted() {
+        submitted.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // worker is -1 when the task was run by a thread outside the pool (i.e. one helping out):
+    void task_completed(int worker, std::chrono::nanoseconds wait_time, std::chrono::nanoseconds exec_time) {
+
+        completed.fetch_add(1, std::memory_order_relaxed);
+        wait_times[duration_histogram::bucket_for(wait_time)].fetch_add(1, std::memory_order_relaxed);
+        exec_times[duration_histogram::bucket_for(exec_time)].fetch_add(1, std::memory_order_relaxed);
+
+        if (worker >= 0) {
+            workers[worker].busy_time.fetch_add(exec_time.count(), std::memory_order_relaxed);
+        }
+
+    }
+
+    void fill(thread_pool_stats &stats) const {
+
+        stats.interval = stats.taken_at - start;
+        stats.submitted = submitted.load(std::memory_order_relaxed);
+        stats.completed = completed.load(std::memory_order_relaxed);
+
+        for (int i = 0; i < duration_histogram::NUM_BUCKETS; i++) {
+            stats.wait_times.counts[i] = wait_times[i].load(std::memory_order_relaxed);
+            stats.exec_times.counts[i] = exec_times[i].load(std::memory_order_relaxed);
+        }
+
+        stats.worker_busy_time.resize(num_workers);
+        for (int i = 0; i < num_workers; i++) {
+            stats.worker_busy_time[i] = std::chrono::nanoseconds(workers[i].busy_time.load(std::memory_order_relaxed));
+        }
+
+    }
+
+private:
+
+    // each on its own cache line, so workers don't fight over them:
+    struct alignas(64) worker_counters {
+        std::atomic<std::int64_t> busy_time{0};
+    };
+
+    const std::chrono::steady_clock::time_point start;
+    const int num_workers;
+    std::unique_ptr<worker_counters[]> workers;
+
+    std::atomic<std::uint64_t> submitted{0};
+    std::atomic<std::uint64_t> completed{0};
+    std::array<std::atomic<std::uint64_t>, duration_histogram::NUM_BUCKETS> wait_times{};
+    std::array<std::atomic<std::uint64_t>, duration_histogram::NUM_BUCKETS> exec_times{};
+
+};
@@ -0,0 +1,146 @@
+// task_group - a set of tasks run on a thread_pool that can be waited on as a whole.
+// Whilst waiting, the waiting thread runs queued tasks itself rather than blocking,
+// and the first exception thrown by any of the group's tasks is rethrown by wait().
+//
+// parallel_for - runs f(i) for i in [begin, end) across a thread_pool. Rather than
+// splitting the range up front, participants (including the calling thread) repeatedly
+// claim the next grain_size indices until the range is used up. So a few slow items
+// only hold up whoever is running them, rather than a whole pre-assigned slice.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <algorithm>
+#include <utility>
+
+#include "./thread-pool.h"
+
+class task_group {
+
+public:
+
+    task_group(thread_pool &pool): pool(pool), num_outstanding(0), failed(false) {}
+
+    ~task_group() {
+
+        // tasks hold a pointer to the group, so it mustn't go away before they're done:
+        wait_for_tasks();
+
+    }
+
+    template <typename F>
+    void run(F&& task) {
+
+        num_outstanding++;
+
+        pool.submit([this, task = std::forward<F>(task)]() mutable {
+
+            try {
+                task();
+            } catch (...) {
+                std::lock_guard lock(exception_mutex);
+                if (!exception) {
+                    exception = std::current_exception();
+                    failed = true;
+                }
+            }
+
+            num_outstanding--;
+
+        });
+
+    }
+
+    // waits for all tasks run so far, and then rethrows the first exception
+    // thrown by any of them (if there was one):
+    void wait() {
+
+        wait_for_tasks();
+
+        std::exception_ptr to_throw;
+        {
+            std::lock_guard lock(exception_mutex);
+            std::swap(to_throw, exception);
+            failed = false;
+        }
+
+        if (to_throw) {
+            std::rethrow_exception(to_throw);
+        }
+
+    }
+
+    // cheap enough to poll, so long running tasks can give up early once another has failed:
+    bool has_failed() const {
+        return failed.load(std::memory_order_relaxed);
+    }
+
+    task_group(const task_group&) = delete;
+    task_group& operator=(const task_group&) = delete;
+
+private:
+
+    thread_pool &pool;
+    std::atomic<int> num_outstanding;
+    std::mutex exception_mutex;
+    std::exception_ptr exception;
+    std::atomic<bool> failed;
+
+    void wait_for_tasks() {
+
+        while (num_outstanding > 0) {
+            if (!pool.run_pending_task()) {
+                // our remaining tasks are already running on other threads:
+                std::this_thread::yield();
+            }
+        }
+
+    }
+
+};
+
+template <typename F>
+void parallel_for(thread_pool &pool, int begin, int end, F&& f, int grain_size = 1) {
+
+    if (begin >= end) { return; }
+
+    grain_size = std::max(grain_size, 1);
+
+    std::atomic<int> next(begin);
+    task_group group(pool);
+
+    auto process = [&]() {
+        while (!group.has_failed()) {
+            int start = next.fetch_add(grain_size);
+            if (start >= end) { break; }
+            for (int i = start, l = std::min(start + grain_size, end); i < l; i++) {
+                f(i);
+            }
+        }
+    };
+
+    // no point starting more helpers than there are grains to go round (the
+    // calling thread takes a share too, hence the - 1):
+    int num_grains = (end - begin + grain_size - 1) / grain_size;
+    int num_helpers = std::min(pool.get_thread_count(), num_grains - 1);
+    for (int i = 0; i < num_helpers; i++) {
+        group.run(process);
+    }
+
+    // the calling thread works through the range as well, rather than sitting idle.
+    // its exceptions are treated the same as those of the helpers:
+    try {
+        process();
+    } catch (...) {
+        // stop the helpers picking up more work, wait for them, then rethrow:
+        next = end;
+        group.wait();
+        throw;
+    }
+
+    group.wait();
+
+}
@@ -1,28 +1,73 @@
+// a work stealing thread pool. Each worker has its own queue: tasks submitted from
+// a worker go onto that worker's queue, and tasks submitted from other threads go
+// onto a shared, bounded, lock-free queue. If that's full, the submitting thread
+// runs queued tasks itself until there's room (so a thread submitting faster than
+// the pool can keep up is slowed down, rather than the queue growing without
+// bound). Idle workers steal from each other's queues, spin for a little while when
+// there's nothing to do, and then park until more work is submitted. Tasks are held
+// in function_wrappers, so submitting a small callable doesn't allocate. A pool's
+// workers can be given a name, a priority and a set of cpus (see thread_pool_options),
+// so that different kinds of work can go to separate pools that don't starve each other.
 
-// TODO: exception handling for tasks!!
-// currently, if task throws, then exception isn't caught by worker and 
-// therefore the thread will call std::terminate
-// TODO: add waiting for tasks to finish - right now this is more or less 
-// just fire and forget
+// NB: submit is fire and forget. To wait for tasks to finish, or to get at exceptions 
+// thrown by tasks, use a task_group (see task-group.h) which wraps its tasks. An 
+// exception escaping a task submitted directly will still call std::terminate. Also,
+// since submit may run other tasks whilst the shared queue is full, don't call it
+// from outside the pool whilst holding a lock those tasks might need
+
+#pragma once
 
 #include <thread>
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include "./function-wrapper.h"
+#include "./work-stealing-queue.h"
+#include "./mpmc-queue.h"
+#include "./pool-stats.h"
+#include "./thread-setup.h"
 
-#include "./threadsafe-queue.h"
+struct thread_pool_options {
+    int num_threads = std::thread::hardware_concurrency();
+    std::size_t injection_capacity = 4096;
+    // workers are named "<name> <index>":
+    std::string name = "pool";
+    thread_priority priority = thread_priority::normal;
+    // cpus the workers may run on (empty means any):
+    std::vector<int> cpus;
+};
 
 class thread_pool {
 
 public:
 
-    thread_pool(int num_threads = std::thread::hardware_concurrency()) {
+    thread_pool(int num_threads = std::thread::hardware_concurrency(), std::size_t injection_capacity = 4096)
+        : thread_pool(make_options(num_threads, injection_capacity)) {}
+
+    // NB: at least one thread is always made
+    thread_pool(const thread_pool_options &options)
+        : options(options), injection_queue(options.injection_capacity), done(false), num_pending(0), num_sleeping(0)
+#ifdef THREAD_POOL_STATS
+            , counters(std::max(options.num_threads, 1))
+#endif
+    {
 
-        // make at least one thread:
-        num_threads = std::max(num_threads, 1);
+        int num_threads = std::max(options.num_threads, 1);
+
+        for (int i = 0; i < num_threads; i++) {
+            queues.push_back(std::make_unique<work_stealing_queue<function_wrapper>>());
+        }
 
         for (int i = 0; i < num_threads; i++) {
 
             try {
-                threads.emplace_back(&thread_pool::worker, this);
+                threads.emplace_back(&thread_pool::worker, this, i);
             } catch (...) {
                 clean_up();
                 throw;
@@ -37,9 +82,52 @@ public:
 
     }
 
-    void submit(std::function<void()> task) {
+    template <typename F>
+    void submit(F&& task) {
+
+#ifdef THREAD_POOL_STATS
+        counters.task_submitted();
+        function_wrapper wrapped(timed(std::forward<F>(task)));
+#else
+        function_wrapper wrapped(std::forward<F>(task));
+#endif
+
+        // NB: counted before it's pushed, so that num_pending never drops below the
+        // number of tasks actually queued (a worker could otherwise take the task and
+        // decrement it first):
+        num_pending.fetch_add(1);
+
+        if (current_pool == this) {
+            queues[current_index]->push(std::move(wrapped));
+        } else {
+            while (!injection_queue.try_push(wrapped)) {
+                // full - so help out until there's room:
+                if (!run_pending_task()) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        // only pay for the lock/notify when a worker is actually parked:
+        if (num_sleeping.load() > 0) {
+            std::lock_guard lock(sleep_mutex);
+            wake.notify_one();
+        }
+
+    }
+
+    // runs a single queued task on the calling thread (if there is one), so that threads
+    // waiting on tasks can help out rather than block. returns false if there was nothing to run
+    bool run_pending_task() {
+
+        function_wrapper task;
+
+        if (!find_task(current_pool == this ? current_index : -1, task)) {
+            return false;
+        }
 
-        work_queue.push(task);
+        task();
+        return true;
 
     }
 
@@ -47,17 +135,76 @@ public:
         return threads.size();
     }
 
+    // whether the calling thread is one of this pool's workers:
+    bool is_worker_thread() const {
+        return current_pool == this;
+    }
+
+    // NB: without THREAD_POOL_STATS, only taken_at and queue_depth are filled in
+    thread_pool_stats get_stats() const {
+
+        thread_pool_stats stats;
+        stats.taken_at = std::chrono::steady_clock::now();
+        stats.queue_depth = num_pending.load(std::memory_order_relaxed);
+#ifdef THREAD_POOL_STATS
+        counters.fill(stats);
+#endif
+        return stats;
+
+    }
+
     thread_pool(const thread_pool&) = delete;
     thread_pool& operator=(const thread_pool&) = delete;
 
 private:
 
+    // how many times an idle worker looks for work before parking:
+    static constexpr int SPIN_COUNT = 64;
+
+    const thread_pool_options options;
+    std::vector<std::unique_ptr<work_stealing_queue<function_wrapper>>> queues;
+    mpmc_queue<function_wrapper> injection_queue;
     std::vector<std::thread> threads;
-    threadsafe_queue<std::function<void()>> work_queue;
+    std::atomic<bool> done;
+    // number of tasks sitting in queues:
+    std::atomic<int> num_pending;
+    std::atomic<int> num_sleeping;
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+#ifdef THREAD_POOL_STATS
+    thread_pool_counters counters;
+#endif
+
+    // which pool (if any) the current thread is a worker of, and its index within that pool:
+    inline static thread_local thread_pool* current_pool = nullptr;
+    inline static thread_local int current_index = 0;
+
+#ifdef THREAD_POOL_STATS
+    // wraps task so that it records how long it waited to be started, and how long it ran for:
+    template <typename F>
+    auto timed(F&& task) {
+
+        return [this, submitted_at = std::chrono::steady_clock::now(), task = std::forward<F>(task)]() mutable {
+
+            auto started_at = std::chrono::steady_clock::now();
+            task();
+            auto finished_at = std::chrono::steady_clock::now();
+
+            counters.task_completed(current_pool == this ? current_index : -1,
+                started_at - submitted_at, finished_at - started_at);
+
+        };
+
+    }
+#endif
 
     void clean_up() {
 
-        work_queue.finish();
+        {
+            std::lock_guard lock(sleep_mutex);
+            done = true;
+        }
+        wake.notify_all();
 
         for (int i = 0, l = threads.size(); i < l; i++) {
             if (threads[i].joinable()) {
@@ -67,13 +214,80 @@ private:
 
     }
 
-    void worker() {
+    // looks in worker index's own queue first, then the shared queue, and then tries
+    // to steal from the other workers (index is -1 for threads outside the pool):
+    bool find_task(int index, function_wrapper &task) {
+
+        if (index >= 0 && queues[index]->try_pop(task)) {
+            num_pending.fetch_sub(1);
+            return true;
+        }
+
+        if (injection_queue.try_pop(task)) {
+            num_pending.fetch_sub(1);
+            return true;
+        }
+
+        int start = std::max(index, 0);
+        for (int i = (index >= 0 ? 1 : 0), l = queues.size(); i < l; i++) {
+            if (queues[(start + i) % l]->try_steal(task)) {
+                num_pending.fetch_sub(1);
+                return true;
+            }
+        }
+
+        return false;
+
+    }
+
+    static thread_pool_options make_options(int num_threads, std::size_t injection_capacity) {
+
+        thread_pool_options options;
+        options.num_threads = num_threads;
+        options.injection_capacity = injection_capacity;
+        return options;
+
+    }
+
+    void worker(int index) {
+
+        current_pool = this;
+        current_index = index;
+
+        set_current_thread_name(options.name + " " + std::to_string(index));
+        set_current_thread_priority(options.priority);
+        set_current_thread_affinity(options.cpus);
+
+        function_wrapper task;
+        int idle_count = 0;
 
         while (true) {
-            std::function<void()> task;
-            bool more_work = work_queue.wait_and_pop(task);
-            if (!more_work) { break; }
-            task();
+
+            if (find_task(index, task)) {
+                task();
+                // release whatever the task captured now, rather than when it's next overwritten:
+                task = function_wrapper();
+                idle_count = 0;
+                continue;
+            }
+
+            if (done) { break; }
+
+            if (++idle_count < SPIN_COUNT) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // park until there's something to do. NB: num_sleeping is incremented before
+            // checking num_pending, whilst submit increments num_pending (before it even
+            // pushes the task) and only then checks num_sleeping, so at least one of them
+            // sees the other and no wake up is lost:
+            std::unique_lock lock(sleep_mutex);
+            num_sleeping++;
+            wake.wait(lock, [this]() { return done || num_pending.load() > 0; });
+            num_sleeping--;
+            idle_count = 0;
+
         }
 
     }
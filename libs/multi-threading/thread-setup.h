@@ -0,0 +1,78 @@
+// platform specific bits for setting up the calling thread: its name (as shown in debuggers
+// and profilers), its scheduling priority, and which CPUs it may run on. These are all
+// best effort - anything a platform doesn't support (or that we don't have permission
+// for) is silently skipped.
+// NB: priorities can only be lowered. Raising a thread above normal generally needs
+// elevated privileges, and we'd rather not compete with the render thread anyway
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#include <pthread/qos.h>
+#endif
+
+enum class thread_priority {
+    normal,
+    // for work that should give way to normal threads, but still get done promptly:
+    low,
+    // for work that can wait until there's nothing else to do:
+    background
+};
+
+inline void set_current_thread_name(const std::string &name) {
+
+#if defined(__linux__)
+    // linux limits names to 15 characters (plus the terminator):
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#elif defined(__APPLE__)
+    pthread_setname_np(name.c_str());
+#else
+    (void)name;
+#endif
+
+}
+
+inline void set_current_thread_priority(thread_priority priority) {
+
+#if defined(__linux__)
+    // on linux, nice values apply per thread:
+    int nice_value = (priority == thread_priority::normal ? 0 : (priority == thread_priority::low ? 5 : 15));
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), nice_value);
+#elif defined(__APPLE__)
+    qos_class_t qos = (priority == thread_priority::normal ? QOS_CLASS_USER_INITIATED :
+        (priority == thread_priority::low ? QOS_CLASS_UTILITY : QOS_CLASS_BACKGROUND));
+    pthread_set_qos_class_self_np(qos, 0);
+#else
+    (void)priority;
+#endif
+
+}
+
+// an empty list of cpus means any cpu:
+inline void set_current_thread_affinity(const std::vector<int> &cpus) {
+
+    if (cpus.empty()) { return; }
+
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    // macOS only has affinity 'tags' (hints for grouping threads), not pinning, so skip it
+    (void)cpus;
+#endif
+
+}
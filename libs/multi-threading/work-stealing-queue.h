@@ -0,0 +1,104 @@
+// a work_stealing_queue - each worker in a thread_pool owns one of these. The owner
+// pushes and pops at the back (so it works on the most recently pushed, and most
+// likely cache-hot, items first) whilst other threads steal from the front (taking
+// the oldest items, which tend to be the biggest bits of outstanding work).
+// NB: the lock is per queue, so it's rarely contended - only when a thief and the
+// owner happen to hit the same queue at the same time
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+template <typename T>
+class work_stealing_queue {
+
+public:
+
+    work_stealing_queue(std::size_t initial_capacity = 256): buffer(round_up_capacity(initial_capacity)), head(0), tail(0) {}
+
+    void push(T value) {
+
+        std::lock_guard lock(queue_mutex);
+
+        // only allocates when the queue grows beyond anything it's held before:
+        if (tail - head == buffer.size()) {
+            grow();
+        }
+
+        buffer[tail & (buffer.size() - 1)] = std::move(value);
+        tail++;
+
+    }
+
+    // pops the most recently pushed item (for use by the owner):
+    bool try_pop(T &return_value) {
+
+        std::lock_guard lock(queue_mutex);
+
+        if (head == tail) {
+            return false;
+        }
+
+        tail--;
+        return_value = std::move(buffer[tail & (buffer.size() - 1)]);
+        return true;
+
+    }
+
+    // pops the least recently pushed item (for use by other threads):
+    bool try_steal(T &return_value) {
+
+        std::lock_guard lock(queue_mutex);
+
+        if (head == tail) {
+            return false;
+        }
+
+        return_value = std::move(buffer[head & (buffer.size() - 1)]);
+        head++;
+        return true;
+
+    }
+
+    bool empty() {
+
+        std::lock_guard lock(queue_mutex);
+        return head == tail;
+
+    }
+
+    work_stealing_queue(const work_stealing_queue&) = delete;
+    work_stealing_queue& operator=(const work_stealing_queue&) = delete;
+
+private:
+
+    // capacity is always a power of two, so that indices can be masked rather than mod-ed:
+    std::vector<T> buffer;
+    std::size_t head;
+    std::size_t tail;
+    std::mutex queue_mutex;
+
+    static std::size_t round_up_capacity(std::size_t capacity) {
+
+        std::size_t result = 1;
+        while (result < capacity) {
+            result <<= 1;
+        }
+        return result;
+
+    }
+
+    void grow() {
+
+        std::vector<T> new_buffer(buffer.size() * 2);
+        for (std::size_t i = head; i != tail; i++) {
+            new_buffer[i & (new_buffer.size() - 1)] = std::move(buffer[i & (buffer.size() - 1)]);
+        }
+        buffer.swap(new_buffer);
+
+    }
+
+};
@@ -0,0 +1,349 @@
+// a composable description of noise based terrain (noise, scale, add, clamp,
+// select, spline etc.) and a compiler that flattens it into a linear plan
+// which is then evaluated over a whole batch of columns at once. Each step
+// of the plan is a tight loop over the batch, so there's no virtual call or
+// branching per sample and the compiler is free to vectorise the loops.
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "./perlin.h"
+
+class NoiseGraph {
+
+public:
+
+    // nodes are referred to by their index within the graph:
+    using Node = int;
+
+    NoiseGraph() {}
+
+    Node constant(float value);
+    // perlin noise (in the range 0 -> 1) sampled at (x * frequency, z * frequency, layer)
+    // NB: layer picks a different 2D slice of the noise, so that otherwise identical
+    // noise nodes can be made independent of each other
+    Node noise(double frequency, double layer);
+    Node scale(Node input, float factor);
+    Node add(Node a, Node b);
+    Node add(Node input, float offset);
+    Node clamp(Node input, float min, float max = std::numeric_limits<float>::max());
+    Node floor(Node input);
+    // picks a where control < threshold and b otherwise, blending linearly between
+    // the two over (threshold - falloff) -> (threshold + falloff):
+    Node select(Node control, Node a, Node b, float threshold, float falloff = 0.0f);
+    // piecewise linear curve through points, which should be sorted by x. Inputs
+    // outside of the curve are clamped to the first/last point:
+    Node spline(Node input, const std::vector<glm::vec2> &points);
+
+private:
+
+    friend class NoisePlan;
+
+    enum class Op { CONSTANT, NOISE, SCALE, ADD, OFFSET, CLAMP, FLOOR, SELECT, SPLINE };
+
+    struct NodeDescription {
+        Op op;
+        Node inputs[3];
+        double params[3];
+    };
+
+    std::vector<NodeDescription> nodes;
+    std::vector<glm::vec2> splinePoints;
+
+    Node addNode(Op op, Node a, Node b, Node c, double p0, double p1, double p2);
+
+};
+
+NoiseGraph::Node NoiseGraph::addNode(Op op, Node a, Node b, Node c, double p0, double p1, double p2) {
+
+    int numNodes = nodes.size();
+
+    // inputs must already exist in the graph (which also means the graph can't have cycles):
+    if (a >= numNodes || b >= numNodes || c >= numNodes) {
+        throw;
+    }
+
+    nodes.push_back({ op, { a, b, c }, { p0, p1, p2 } });
+    return numNodes;
+
+}
+
+NoiseGraph::Node NoiseGraph::constant(float value) {
+    return addNode(Op::CONSTANT, -1, -1, -1, value, 0, 0);
+}
+
+NoiseGraph::Node NoiseGraph::noise(double frequency, double layer) {
+    return addNode(Op::NOISE, -1, -1, -1, frequency, layer, 0);
+}
+
+NoiseGraph::Node NoiseGraph::scale(Node input, float factor) {
+    return addNode(Op::SCALE, input, -1, -1, factor, 0, 0);
+}
+
+NoiseGraph::Node NoiseGraph::add(Node a, Node b) {
+    return addNode(Op::ADD, a, b, -1, 0, 0, 0);
+}
+
+NoiseGraph::Node NoiseGraph::add(Node input, float offset) {
+    return addNode(Op::OFFSET, input, -1, -1, offset, 0, 0);
+}
+
+NoiseGraph::Node NoiseGraph::clamp(Node input, float min, float max) {
+    return addNode(Op::CLAMP, input, -1, -1, min, max, 0);
+}
+
+NoiseGraph::Node NoiseGraph::floor(Node input) {
+    return addNode(Op::FLOOR, input, -1, -1, 0, 0, 0);
+}
+
+NoiseGraph::Node NoiseGraph::select(Node control, Node a, Node b, float threshold, float falloff) {
+    return addNode(Op::SELECT, control, a, b, threshold, falloff, 0);
+}
+
+NoiseGraph::Node NoiseGraph::spline(Node input, const std::vector<glm::vec2> &points) {
+
+    if (points.empty()) {
+        throw;
+    }
+
+    int start = splinePoints.size();
+    splinePoints.insert(splinePoints.end(), points.begin(), points.end());
+    return addNode(Op::SPLINE, input, -1, -1, start, points.size(), 0);
+
+}
+
+class NoisePlan {
+
+public:
+
+    // compiles the parts of graph needed to calculate outputs into a plan:
+    NoisePlan(const NoiseGraph &graph, const std::vector<NoiseGraph::Node> &outputs, unsigned int seed);
+
+    int getOutputCount() const { return outputRegisters.size(); }
+
+    // evaluates the plan over a sizeX by sizeZ grid of columns, starting at world
+    // position (x, z) with columns step apart. The value of output o for column
+    // (i, j) is written to out[(o * sizeX + i) * sizeZ + j]
+    // NB: this is thread-safe
+    void evaluate(int x, int z, int sizeX, int sizeZ, int step, float* out) const;
+
+    NoisePlan(const NoisePlan&) = delete;
+    NoisePlan& operator=(const NoisePlan&) = delete;
+
+private:
+
+    struct Step {
+        NoiseGraph::Op op;
+        int output;
+        int inputs[3];
+        double params[3];
+    };
+
+    PerlinNoise noise;
+    std::vector<Step> steps;
+    std::vector<glm::vec2> splinePoints;
+    std::vector<int> outputRegisters;
+    int numRegisters;
+
+};
+
+NoisePlan::NoisePlan(const NoiseGraph &graph, const std::vector<NoiseGraph::Node> &outputs, unsigned int seed)
+    : noise(seed), splinePoints(graph.splinePoints), numRegisters(0) {
+
+    int numNodes = graph.nodes.size();
+
+    // nodes are only ever added after their inputs, so the graph's order is already a
+    // valid evaluation order. We just need to find which nodes are actually used, and
+    // the last step that reads each of them:
+    std::vector<bool> used(numNodes, false);
+    std::vector<int> lastUse(numNodes, -1);
+
+    for (NoiseGraph::Node output : outputs) {
+        if (output < 0 || output >= numNodes) {
+            throw;
+        }
+        used[output] = true;
+        // outputs need to survive until the end of the plan:
+        lastUse[output] = numNodes;
+    }
+
+    for (int i = numNodes - 1; i >= 0; i--) {
+        if (!used[i]) { continue; }
+        for (NoiseGraph::Node input : graph.nodes[i].inputs) {
+            if (input < 0) { continue; }
+            used[input] = true;
+            lastUse[input] = std::max(lastUse[input], i);
+        }
+    }
+
+    // assign each used node a register, reusing registers once the values
+    // in them are no longer needed so that the working set stays small:
+    std::vector<int> nodeRegisters(numNodes, -1);
+    std::vector<int> freeRegisters;
+
+    for (int i = 0; i < numNodes; i++) {
+
+        if (!used[i]) { continue; }
+
+        const NoiseGraph::NodeDescription &node = graph.nodes[i];
+
+        Step step { node.op, -1, { -1, -1, -1 }, { node.params[0], node.params[1], node.params[2] } };
+        for (int j = 0; j < 3; j++) {
+            if (node.inputs[j] >= 0) {
+                step.inputs[j] = nodeRegisters[node.inputs[j]];
+            }
+        }
+
+        // inputs that aren't read after this step can be overwritten by its output
+        // (every op reads its inputs at a given sample before writing its output):
+        for (int j = 0; j < 3; j++) {
+            NoiseGraph::Node input = node.inputs[j];
+            if (input >= 0 && lastUse[input] == i && nodeRegisters[input] >= 0) {
+                freeRegisters.push_back(nodeRegisters[input]);
+                // make sure a node used twice as an input isn't freed twice:
+                nodeRegisters[input] = -1;
+            }
+        }
+
+        if (freeRegisters.empty()) {
+            step.output = numRegisters++;
+        } else {
+            step.output = freeRegisters.back();
+            freeRegisters.pop_back();
+        }
+        nodeRegisters[i] = step.output;
+
+        steps.push_back(step);
+
+    }
+
+    for (NoiseGraph::Node output : outputs) {
+        outputRegisters.push_back(nodeRegisters[output]);
+    }
+
+}
+
+void NoisePlan::evaluate(int x, int z, int sizeX, int sizeZ, int step, float* out) const {
+
+    const int batchSize = sizeX * sizeZ;
+
+    // scratch space for the registers. it's kept per thread so that
+    // evaluating doesn't allocate once it's warmed up:
+    thread_local std::vector<float> scratch;
+    scratch.resize(std::max(static_cast<size_t>(numRegisters * batchSize), scratch.size()));
+
+    for (const Step &s : steps) {
+
+        float* result = &scratch[s.output * batchSize];
+        const float* a = (s.inputs[0] >= 0 ? &scratch[s.inputs[0] * batchSize] : nullptr);
+        const float* b = (s.inputs[1] >= 0 ? &scratch[s.inputs[1] * batchSize] : nullptr);
+        const float* c = (s.inputs[2] >= 0 ? &scratch[s.inputs[2] * batchSize] : nullptr);
+
+        switch (s.op) {
+
+            case NoiseGraph::Op::CONSTANT:
+                std::fill(result, result + batchSize, static_cast<float>(s.params[0]));
+                break;
+
+            case NoiseGraph::Op::NOISE:
+                for (int i = 0; i < sizeX; i++) {
+                    double sampleX = static_cast<double>(x + i * step) * s.params[0];
+                    for (int j = 0; j < sizeZ; j++) {
+                        double sampleZ = static_cast<double>(z + j * step) * s.params[0];
+                        result[i * sizeZ + j] = noise.noise(sampleX, sampleZ, s.params[1]);
+                    }
+                }
+                break;
+
+            case NoiseGraph::Op::SCALE: {
+                const float factor = s.params[0];
+                for (int i = 0; i < batchSize; i++) {
+                    result[i] = a[i] * factor;
+                }
+                break;
+            }
+
+            case NoiseGraph::Op::ADD:
+                for (int i = 0; i < batchSize; i++) {
+                    result[i] = a[i] + b[i];
+                }
+                break;
+
+            case NoiseGraph::Op::OFFSET: {
+                const float offset = s.params[0];
+                for (int i = 0; i < batchSize; i++) {
+                    result[i] = a[i] + offset;
+                }
+                break;
+            }
+
+            case NoiseGraph::Op::CLAMP: {
+                const float min = s.params[0];
+                const float max = s.params[1];
+                for (int i = 0; i < batchSize; i++) {
+                    result[i] = std::min(std::max(a[i], min), max);
+                }
+                break;
+            }
+
+            case NoiseGraph::Op::FLOOR:
+                for (int i = 0; i < batchSize; i++) {
+                    result[i] = std::floor(a[i]);
+                }
+                break;
+
+            case NoiseGraph::Op::SELECT: {
+                const float threshold = s.params[0];
+                const float falloff = s.params[1];
+                if (falloff <= 0) {
+                    for (int i = 0; i < batchSize; i++) {
+                        result[i] = (a[i] < threshold ? b[i] : c[i]);
+                    }
+                } else {
+                    const float lower = threshold - falloff;
+                    const float inverseWidth = 1.0f / (2 * falloff);
+                    for (int i = 0; i < batchSize; i++) {
+                        float t = std::min(std::max((a[i] - lower) * inverseWidth, 0.0f), 1.0f);
+                        result[i] = b[i] + t * (c[i] - b[i]);
+                    }
+                }
+                break;
+            }
+
+            case NoiseGraph::Op::SPLINE: {
+                const glm::vec2* points = &splinePoints[static_cast<int>(s.params[0])];
+                const int numPoints = s.params[1];
+                for (int i = 0; i < batchSize; i++) {
+                    float value = a[i];
+                    if (value <= points[0].x) {
+                        result[i] = points[0].y;
+                        continue;
+                    }
+                    int k = 1;
+                    while (k < numPoints && value > points[k].x) { k++; }
+                    if (k == numPoints) {
+                        result[i] = points[numPoints - 1].y;
+                        continue;
+                    }
+                    float t = (value - points[k - 1].x) / (points[k].x - points[k - 1].x);
+                    result[i] = points[k - 1].y + t * (points[k].y - points[k - 1].y);
+                }
+                break;
+            }
+
+        }
+
+    }
+
+    for (int o = 0, l = outputRegisters.size(); o < l; o++) {
+        const float* result = &scratch[outputRegisters[o] * batchSize];
+        std::copy(result, result + batchSize, out + o * batchSize);
+    }
+
+}
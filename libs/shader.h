@@ -6,17 +6,42 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <unordered_map>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+// a uniform's location, tagged with the type of value it holds. Get these once (via 
+// Shader::getUniform) and then use them to set uniforms, so that there are no lookups 
+// by name in the per-frame path. A handle for a uniform that doesn't exist (or that's 
+// been optimised out by the compiler) has location -1, and setting it does nothing:
+template <typename T>
+struct Uniform {
+    GLint location = -1;
+};
+
 class Shader {
 
 public:
     Shader(const std::string &vertexCode, const std::string &fragmentCode);
     ~Shader();
 
+    template <typename T>
+    Uniform<T> getUniform(const std::string &name) const;
+
+    void setUniform(Uniform<int> uniform, int value) const;
+    void setUniform(Uniform<float> uniform, float value) const;
+    void setUniform(Uniform<glm::vec2> uniform, const glm::vec2 &value) const;
+    void setUniform(Uniform<glm::ivec2> uniform, const glm::ivec2 &value) const;
+    void setUniform(Uniform<glm::vec3> uniform, const glm::vec3 &value) const;
+    void setUniform(Uniform<glm::vec4> uniform, const glm::vec4 &value) const;
+    void setUniform(Uniform<glm::mat3> uniform, const glm::mat3 &matrix) const;
+    void setUniform(Uniform<glm::mat4> uniform, const glm::mat4 &matrix) const;
+
+    // these look the uniform up by name each time (albeit in the cache rather than 
+    // asking GL), so are best kept for one-off setup:
+
     // REVIEW: should these really be const? They aren't mutating the local application data 
     // (hence they're const as far as the compiler is concerned) but they are mutating state 
     // of the shader on the GPU
@@ -41,8 +66,12 @@ public:
 
 private:
     GLuint shaderProgramId;
+    // every active uniform's location, read once the program's linked:
+    std::unordered_map<std::string, GLint> uniformLocations;
 
     GLuint compileShader(const std::string &shaderCode, GLenum shaderType);
+    void cacheUniformLocations();
+    GLint getUniformLocation(const std::string &name) const;
 
 };
 
@@ -81,6 +110,8 @@ Shader::Shader(const std::string &vertexCode, const std::string &fragmentCode) {
     glDeleteShader(vertexId);
     glDeleteShader(fragmentId);
 
+    cacheUniformLocations();
+
 }
 
 Shader::~Shader() {
@@ -92,43 +123,80 @@ void Shader::useShader() {
 }
 
 void Shader::setUniformInt(const std::string &name, int value) const { 
-    glUniform1i(glGetUniformLocation(shaderProgramId, name.c_str()), value);
+    glUniform1i(getUniformLocation(name), value);
 }
 
 void Shader::setUniformFloat(const std::string &name, float value) const { 
-    glUniform1f(glGetUniformLocation(shaderProgramId, name.c_str()), value);
+    glUniform1f(getUniformLocation(name), value);
 }
 
 void Shader::setUniformVec2(const std::string &name, const glm::vec2 &value) const { 
-    glUniform2fv(glGetUniformLocation(shaderProgramId, name.c_str()), 1, glm::value_ptr(value));
+    glUniform2fv(getUniformLocation(name), 1, glm::value_ptr(value));
 }
 
 void Shader::setUniformVec2(const std::string &name, float x, float y) const { 
-    glUniform2f(glGetUniformLocation(shaderProgramId, name.c_str()), x, y);
+    glUniform2f(getUniformLocation(name), x, y);
 }
 
 void Shader::setUniformVec3(const std::string &name, const glm::vec3 &value) const { 
-    glUniform3fv(glGetUniformLocation(shaderProgramId, name.c_str()), 1, glm::value_ptr(value));
+    glUniform3fv(getUniformLocation(name), 1, glm::value_ptr(value));
 }
 
 void Shader::setUniformVec3(const std::string &name, float x, float y, float z) const { 
-    glUniform3f(glGetUniformLocation(shaderProgramId, name.c_str()), x, y, z);
+    glUniform3f(getUniformLocation(name), x, y, z);
 }
 
 void Shader::setUniformVec4(const std::string &name, const glm::vec4 &value) const { 
-    glUniform4fv(glGetUniformLocation(shaderProgramId, name.c_str()), 1, glm::value_ptr(value));
+    glUniform4fv(getUniformLocation(name), 1, glm::value_ptr(value));
 }
 
 void Shader::setUniformVec4(const std::string &name, float x, float y, float z, float w) const { 
-    glUniform4f(glGetUniformLocation(shaderProgramId, name.c_str()), x, y, z, w);
+    glUniform4f(getUniformLocation(name), x, y, z, w);
 }
 
 void Shader::setUniformMat3(const std::string &name, const glm::mat3 &matrix) const {
-    glUniformMatrix3fv(glGetUniformLocation(shaderProgramId, name.c_str()), 1, GL_FALSE, glm::value_ptr(matrix));
+    glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, glm::value_ptr(matrix));
 }
 
 void Shader::setUniformMat4(const std::string &name, const glm::mat4 &matrix) const {
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgramId, name.c_str()), 1, GL_FALSE, glm::value_ptr(matrix));
+    glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, glm::value_ptr(matrix));
+}
+
+template <typename T>
+Uniform<T> Shader::getUniform(const std::string &name) const {
+    return Uniform<T>{ getUniformLocation(name) };
+}
+
+void Shader::setUniform(Uniform<int> uniform, int value) const {
+    glUniform1i(uniform.location, value);
+}
+
+void Shader::setUniform(Uniform<float> uniform, float value) const {
+    glUniform1f(uniform.location, value);
+}
+
+void Shader::setUniform(Uniform<glm::vec2> uniform, const glm::vec2 &value) const {
+    glUniform2fv(uniform.location, 1, glm::value_ptr(value));
+}
+
+void Shader::setUniform(Uniform<glm::ivec2> uniform, const glm::ivec2 &value) const {
+    glUniform2i(uniform.location, value.x, value.y);
+}
+
+void Shader::setUniform(Uniform<glm::vec3> uniform, const glm::vec3 &value) const {
+    glUniform3fv(uniform.location, 1, glm::value_ptr(value));
+}
+
+void Shader::setUniform(Uniform<glm::vec4> uniform, const glm::vec4 &value) const {
+    glUniform4fv(uniform.location, 1, glm::value_ptr(value));
+}
+
+void Shader::setUniform(Uniform<glm::mat3> uniform, const glm::mat3 &matrix) const {
+    glUniformMatrix3fv(uniform.location, 1, GL_FALSE, glm::value_ptr(matrix));
+}
+
+void Shader::setUniform(Uniform<glm::mat4> uniform, const glm::mat4 &matrix) const {
+    glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(matrix));
 }
 
 void Shader::setUniformBufferBindingPoint(const std::string &name, GLuint bindingPoint) const {
@@ -161,3 +229,41 @@ GLuint Shader::compileShader(const std::string &shaderCode, GLenum shaderType) {
     return shaderId;
 
 }
+
+void Shader::cacheUniformLocations() {
+
+    GLint numUniforms = 0;
+    glGetProgramiv(shaderProgramId, GL_ACTIVE_UNIFORMS, &numUniforms);
+    GLint maxNameLength = 0;
+    glGetProgramiv(shaderProgramId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    std::vector<GLchar> name(std::max(maxNameLength, 1));
+
+    for (GLint i = 0; i < numUniforms; i++) {
+
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(shaderProgramId, i, name.size(), &length, &size, &type, &name[0]);
+
+        std::string uniformName(&name[0], length);
+        GLint location = glGetUniformLocation(shaderProgramId, uniformName.c_str());
+        // NB: uniforms in blocks don't have locations:
+        if (location < 0) { continue; }
+
+        // arrays are reported as "name[0]", but are also looked up as plain "name":
+        if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0) {
+            uniformLocations[uniformName.substr(0, uniformName.size() - 3)] = location;
+        }
+        uniformLocations[uniformName] = location;
+
+    }
+
+}
+
+GLint Shader::getUniformLocation(const std::string &name) const {
+
+    auto search = uniformLocations.find(name);
+    return (search == uniformLocations.end() ? -1 : search->second);
+
+}
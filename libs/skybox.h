@@ -103,16 +103,18 @@ public:
 private:
 
     Shader shader;
+    Uniform<glm::mat4> viewUniform;
     CubeMap cubemap;
     GLuint skyboxVBO, skyboxVAO;
 
 };
 
 SkyBox::SkyBox(const std::vector<std::string> &filePaths, const glm::mat4 &projection)
-    : shader(vertexShader, fragmentShader), cubemap(filePaths) {
+    : shader(vertexShader, fragmentShader), viewUniform(shader.getUniform<glm::mat4>("view")), cubemap(filePaths) {
 
     shader.useShader();
     shader.setUniformMat4("projection", projection);
+    shader.setUniformInt("skybox", 0);
 
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
@@ -142,9 +144,8 @@ void SkyBox::render(const glm::mat4 &view) {
 
     shader.useShader();
     // want the view without translation:
-    shader.setUniformMat4("view", glm::mat4(glm::mat3(view)));
+    shader.setUniform(viewUniform, glm::mat4(glm::mat3(view)));
     cubemap.useCubeMap(GL_TEXTURE0);
-    shader.setUniformInt("skybox", 0);
     glBindVertexArray(skyboxVAO);
     glDepthFunc(GL_LEQUAL);
     glDrawArrays(GL_TRIANGLES, 0, 36);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstring>
+
+#include <glad/glad.h>
+
+// a uniform buffer object holding a single T, bound to bindingPoint (shaders pick it up
+// via Shader::setUniformBufferBindingPoint). T needs to be laid out to match the block's
+// std140 layout: in short, vec3s and vec4s start on 16 byte boundaries (a lone float can
+// go straight after a vec3), mat4s are 4 vec4s, and the whole thing is padded out to a
+// multiple of 16 bytes.
+//
+// set only uploads when the value has actually changed, so it's fine to call every frame.
+// NB: values are compared bytewise, so give T explicit padding members rather than
+// leaving gaps for the compiler to fill with whatever
+template <typename T>
+class UniformBuffer {
+
+public:
+
+    static_assert(sizeof(T) % 16 == 0, "uniform blocks need padding out to a multiple of 16 bytes");
+
+    UniformBuffer(GLuint bindingPoint): bindingPoint(bindingPoint), hasValue(false) {
+
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        glBindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, UBO, 0, sizeof(T));
+
+    }
+    ~UniformBuffer() {
+
+        glDeleteBuffers(1, &UBO);
+
+    }
+
+    void set(const T &newValue) {
+
+        if (hasValue && std::memcmp(&value, &newValue, sizeof(T)) == 0) {
+            return;
+        }
+
+        value = newValue;
+        hasValue = true;
+
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &value);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    }
+
+    GLuint getBindingPoint() const { return bindingPoint; }
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+private:
+
+    GLuint UBO;
+    const GLuint bindingPoint;
+    bool hasValue;
+    // the last value uploaded:
+    T value;
+
+};
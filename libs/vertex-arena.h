@@ -0,0 +1,276 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdint>
+
+#include <glad/glad.h>
+
+// VertexArena keeps lots of small meshes in one big buffer, so that they can all be drawn
+// with a single glMultiDrawArrays rather than a bind and a draw each.
+//
+// Space is handed out from a free list (best fit, with neighbouring free ranges merged as
+// they're freed). When nothing fits, the live meshes are copied - GPU side - into a fresh
+// buffer, packed together with no gaps (and the buffer doubles in size if it's getting
+// full). So fragmentation is cleaned up at the same point the arena would otherwise grow.
+// Meshes are referred to by handles rather than offsets, as that repacking moves them.
+// The buffer never grows past what a buffer texture can hold (GL_MAX_TEXTURE_BUFFER_SIZE,
+// which can be as little as 64k texels), so once it's that big and full, allocate fails.
+//
+// Meshes are made of fixed size elements (e.g. packed faces), which aren't vertex
+// attributes: the buffer's exposed to the vertex shader as a buffer texture (with one
+// texel per element, in the given format), and the shader fetches what it needs using
+// gl_VertexID (i.e. 'vertex pulling'). So there are no attributes, and the VAO's empty.
+// NB: everything here makes GL calls, so must be done on the main thread
+class VertexArena {
+
+public:
+
+    using Handle = int;
+    static constexpr Handle NO_HANDLE = -1;
+
+    // elementSize is in bytes, and textureFormat the matching buffer texture format
+    // (e.g. GL_RG32UI for 8 byte elements). NB: initialCapacity is capped at the most
+    // a buffer texture can hold:
+    VertexArena(int elementSize, GLenum textureFormat, int initialCapacity)
+        : elementSize(elementSize), textureFormat(textureFormat), used(0) {
+
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxCapacity);
+        capacity = std::max(std::min(initialCapacity, static_cast<int>(maxCapacity)), 1);
+
+        glGenVertexArrays(1, &VAO);
+        glGenTextures(1, &texture);
+        VBO = createBuffer(capacity);
+        attachTexture();
+
+        freeRanges.insert({ 0, capacity });
+
+    }
+    ~VertexArena() {
+
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteTextures(1, &texture);
+        glDeleteBuffers(1, &VBO);
+
+    }
+
+    // makes space for numElements elements. returns NO_HANDLE if there isn't room, even
+    // with the buffer as big as it's allowed to get:
+    Handle allocate(int numElements) {
+
+        int offset = findSpace(numElements);
+        if (offset < 0) {
+            if (!repack(numElements)) {
+                return NO_HANDLE;
+            }
+            offset = findSpace(numElements);
+        }
+
+        Handle handle;
+        if (!freeHandles.empty()) {
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+        } else {
+            handle = allocations.size();
+            allocations.emplace_back();
+        }
+
+        allocations[handle] = { offset, numElements, true };
+        used += numElements;
+
+        return handle;
+
+    }
+
+    void free(Handle handle) {
+
+        Allocation &allocation = allocations[handle];
+        if (!allocation.live) {
+            throw;
+        }
+
+        allocation.live = false;
+        used -= allocation.size;
+        freeHandles.push_back(handle);
+        releaseRange(allocation.offset, allocation.size);
+
+    }
+
+    // copies the allocation's worth of elements from the start of source into it:
+    void copyFrom(GLuint source, Handle handle) {
+
+        const Allocation &allocation = allocations[handle];
+
+        glBindBuffer(GL_COPY_READ_BUFFER, source);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+            bytes(allocation.offset), bytes(allocation.size));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    }
+
+    // the index of the allocation's first element:
+    // NB: only valid until the next call to allocate
+    int getFirst(Handle handle) const {
+        return allocations[handle].offset;
+    }
+
+    // binds the (empty) VAO, and the buffer texture to textureUnit. NB: leaves textureUnit
+    // as the active texture unit
+    void bind(GLenum textureUnit) const {
+        glBindVertexArray(VAO);
+        glActiveTexture(textureUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+    }
+
+    int getElementSize() const { return elementSize; }
+    int getCapacity() const { return capacity; }
+    int getUsed() const { return used; }
+
+    VertexArena(const VertexArena&) = delete;
+    VertexArena& operator=(const VertexArena&) = delete;
+
+private:
+
+    struct Allocation {
+        int offset;
+        int size;
+        bool live;
+    };
+
+    const int elementSize;
+    const GLenum textureFormat;
+    GLuint VAO, VBO, texture;
+    // in elements:
+    int capacity;
+    int used;
+    // the most texels a buffer texture can have:
+    GLint maxCapacity;
+    std::vector<Allocation> allocations;
+    std::vector<Handle> freeHandles;
+    // offset -> size, in elements:
+    std::map<int, int> freeRanges;
+
+    GLsizeiptr bytes(int numElements) const {
+        return static_cast<GLsizeiptr>(numElements) * elementSize;
+    }
+
+    GLuint createBuffer(int numElements) const {
+
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, bytes(numElements), nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        return buffer;
+
+    }
+
+    // points the buffer texture at the (current) buffer:
+    void attachTexture() {
+
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, textureFormat, VBO);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    }
+
+    // best fit. returns -1 if there's no range big enough:
+    int findSpace(int numElements) {
+
+        auto best = freeRanges.end();
+        for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+            if (it->second >= numElements && (best == freeRanges.end() || it->second < best->second)) {
+                best = it;
+            }
+        }
+
+        if (best == freeRanges.end()) {
+            return -1;
+        }
+
+        int offset = best->first;
+        int remaining = best->second - numElements;
+        freeRanges.erase(best);
+        if (remaining > 0) {
+            freeRanges.insert({ offset + numElements, remaining });
+        }
+
+        return offset;
+
+    }
+
+    // returns a range to the free list, merging it with any free neighbours:
+    void releaseRange(int offset, int size) {
+
+        auto next = freeRanges.lower_bound(offset);
+
+        if (next != freeRanges.end() && offset + size == next->first) {
+            size += next->second;
+            next = freeRanges.erase(next);
+        }
+
+        if (next != freeRanges.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                previous->second += size;
+                return;
+            }
+        }
+
+        freeRanges.insert({ offset, size });
+
+    }
+
+    // copies all the live allocations, packed together, into a new buffer with room for
+    // at least another extraElements (doubling the capacity until it's no more than
+    // three quarters full, or as big as a buffer texture can be). returns false, leaving
+    // everything as it was, if even the biggest buffer couldn't fit them in:
+    bool repack(int extraElements) {
+
+        // NB: in 64 bits, as the doubling can pass INT_MAX on the way to maxCapacity:
+        std::int64_t needed = static_cast<std::int64_t>(used) + extraElements;
+        if (needed > maxCapacity) {
+            return false;
+        }
+
+        std::int64_t newCapacity = capacity;
+        while (needed * 4 > newCapacity * 3 && newCapacity < maxCapacity) {
+            newCapacity *= 2;
+        }
+        newCapacity = std::min<std::int64_t>(newCapacity, maxCapacity);
+
+        GLuint newVBO = createBuffer(newCapacity);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, VBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+
+        int offset = 0;
+        for (Allocation &allocation : allocations) {
+            if (!allocation.live || allocation.size == 0) { continue; }
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                bytes(allocation.offset), bytes(offset), bytes(allocation.size));
+            allocation.offset = offset;
+            offset += allocation.size;
+        }
+
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glDeleteBuffers(1, &VBO);
+        VBO = newVBO;
+        capacity = static_cast<int>(newCapacity);
+        attachTexture();
+
+        freeRanges.clear();
+        if (offset < capacity) {
+            freeRanges.insert({ offset, capacity - offset });
+        }
+
+        return true;
+
+    }
+
+};
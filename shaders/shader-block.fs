@@ -1,24 +1,24 @@
 
 #version 330 core
 
-struct Material {
-    sampler2DArray diffuseTexture;
-
-    int shininess;
+// NB: must match the block in shader-block.vs
+layout (std140) uniform Matrices {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
 };
 
-struct DirectionalLight {
-    vec3 direction;
-    vec3 colour;
-
+// a directional light, plus the material properties that are the same for every block:
+layout (std140) uniform Lighting {
+    vec3 lightDirection;
     float ambientIntensity;
+    vec3 lightColour;
     float diffuseIntensity;
     float specularIntensity;
+    float shininess;
 };
 
-uniform Material material;
-uniform DirectionalLight light;
-uniform vec3 viewPosition;
+uniform sampler2DArray diffuseTexture;
 
 in vec3 normal;
 in vec3 fragmentPosition;
@@ -28,24 +28,24 @@ out vec4 colour;
 
 void main() {
 
-    vec3 diffuseColour = vec3(texture(material.diffuseTexture, textureCoords));
+    vec3 diffuseColour = vec3(texture(diffuseTexture, textureCoords));
 
     // ambient
-    vec3 ambientLight = light.ambientIntensity * light.colour * diffuseColour;
+    vec3 ambientLight = ambientIntensity * lightColour * diffuseColour;
 
     // diffuse
     vec3 norm = normalize(normal);
-    // light.direction is the direction that the light is shining towards, but we want 
+    // lightDirection is the direction that the light is shining towards, but we want 
     // lightDir to be the vector pointing towards the light, hence the -ve
-    vec3 lightDir = normalize(-light.direction);
+    vec3 lightDir = normalize(-lightDirection);
     float diffuseCoefficient = max(dot(norm, lightDir), 0.0);
-    vec3 diffuseLight = light.diffuseIntensity * light.colour * diffuseCoefficient * diffuseColour;
+    vec3 diffuseLight = diffuseIntensity * lightColour * diffuseCoefficient * diffuseColour;
 
     // specular using Blinn-Phong
     vec3 viewDir = normalize(viewPosition - fragmentPosition);
     vec3 halfwayDir = normalize(lightDir + viewDir);
-    float specularCoefficient = pow(max(dot(norm, halfwayDir), 0.0), material.shininess);
-    vec3 specularLight = light.specularIntensity * light.colour * specularCoefficient * diffuseColour;
+    float specularCoefficient = pow(max(dot(norm, halfwayDir), 0.0), shininess);
+    vec3 specularLight = specularIntensity * lightColour * specularCoefficient * diffuseColour;
 
     vec3 result = ambientLight + diffuseLight + specularLight;
     colour = vec4(result, 1.0);
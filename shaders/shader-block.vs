@@ -1,28 +1,71 @@
-
 #version 330 core
 
+// NB: must match the block in shader-block.fs
 layout (std140) uniform Matrices {
     mat4 projection;
     mat4 view;
+    vec3 viewPosition;
 };
-uniform mat4 model;
-uniform mat3 normalMatrix;
 
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec3 aTexCoords;
+// the chunks' meshes, as packed faces (see Chunk::WORDS_PER_FACE, which this has to
+// match). There are no vertex attributes: each face is drawn as 6 vertices, and each
+// vertex fetches its face, and works out which corner it is, from gl_VertexID:
+uniform usamplerBuffer faces;
 
 out vec3 normal;
 out vec3 fragmentPosition;
 out vec3 textureCoords;
 
+// in the order of Chunk::Face (LEFT, RIGHT, BOTTOM, TOP, BACK, FRONT):
+const vec3 NORMALS[6] = vec3[6](
+    vec3(-1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0),
+    vec3(0.0, -1.0, 0.0), vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, -1.0), vec3(0.0, 0.0, 1.0)
+);
+
+// each face's four corners (anticlockwise from outside, as two triangles 0 1 2 and 0 3 1):
+const vec3 CORNERS[24] = vec3[24](
+    vec3(0.0, 0.0, 0.0), vec3(0.0, 1.0, 1.0), vec3(0.0, 1.0, 0.0), vec3(0.0, 0.0, 1.0),
+    vec3(1.0, 0.0, 1.0), vec3(1.0, 1.0, 0.0), vec3(1.0, 1.0, 1.0), vec3(1.0, 0.0, 0.0),
+    vec3(1.0, 0.0, 1.0), vec3(0.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0), vec3(0.0, 0.0, 1.0),
+    vec3(0.0, 1.0, 1.0), vec3(1.0, 1.0, 0.0), vec3(0.0, 1.0, 0.0), vec3(1.0, 1.0, 1.0),
+    vec3(1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0), vec3(1.0, 1.0, 0.0), vec3(0.0, 0.0, 0.0),
+    vec3(0.0, 0.0, 1.0), vec3(1.0, 1.0, 1.0), vec3(0.0, 1.0, 1.0), vec3(1.0, 0.0, 1.0)
+);
+// (which are the same for every face):
+const vec2 CORNER_TEXTURE_COORDS[4] = vec2[4](
+    vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0), vec2(1.0, 0.0)
+);
+const int TRIANGLE_CORNERS[6] = int[6](0, 1, 2, 0, 3, 1);
+
+// x and z are 19 bit two's complement:
+int signExtend(uint value) {
+    return int(value & 0x3FFFFu) - int(value & 0x40000u);
+}
+
 void main() {
 
-    vec4 worldPosition = model * vec4(aPos, 1.0);
+    uvec2 face = texelFetch(faces, gl_VertexID / 6).rg;
+    int corner = TRIANGLE_CORNERS[gl_VertexID % 6];
+
+    int direction = int((face.x >> 27) & 0x7u);
+    float voxelSize = float(1u << (face.x >> 30));
+    float height = float((face.y >> 29) + 1u);
+    vec3 block = vec3(signExtend(face.x), float((face.x >> 19) & 0xFFu), signExtend(face.y));
+
+    // tall faces (skirts) are stretched upwards, and repeat the texture rather than
+    // stretching it:
+    vec3 offset = CORNERS[direction * 4 + corner];
+    offset.y *= height;
+    vec2 cornerTextureCoords = CORNER_TEXTURE_COORDS[corner];
+
+    // chunk meshes are in world space, and blocks are axis aligned and never rotated or
+    // scaled, so there's no need for model/normal matrices:
+    vec4 worldPosition = vec4((block + offset) * voxelSize, 1.0);
 
-    normal = normalMatrix * aNormal;
-    fragmentPosition = (worldPosition).xyz;
-    textureCoords = aTexCoords;
+    normal = NORMALS[direction];
+    fragmentPosition = worldPosition.xyz;
+    textureCoords = vec3(cornerTextureCoords.x, cornerTextureCoords.y * height, float((face.y >> 19) & 0x3FFu));
 
     gl_Position = projection * view * worldPosition;
     
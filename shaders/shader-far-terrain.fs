@@ -0,0 +1,51 @@
+#version 330 core
+
+// NB: must match the block in shader-block.fs
+layout (std140) uniform Lighting {
+    vec3 lightDirection;
+    float ambientIntensity;
+    vec3 lightColour;
+    float diffuseIntensity;
+    float specularIntensity;
+    float shininess;
+};
+
+// NB: must match the block in shader-far-terrain.vs
+layout (std140) uniform Matrices {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+// nothing's drawn within holeRadius of the camera (along x or z), as that's where the
+// chunks are:
+uniform float holeRadius;
+// the terrain fades into fogColour (i.e. the sky) between fogStart and fogEnd:
+uniform float fogStart;
+uniform float fogEnd;
+uniform vec3 fogColour;
+
+in vec3 normal;
+in vec3 fragmentPosition;
+in vec3 surfaceColour;
+
+out vec4 colour;
+
+void main() {
+
+    vec2 offset = abs(fragmentPosition.xz - viewPosition.xz);
+    if (max(offset.x, offset.y) < holeRadius) {
+        discard;
+    }
+
+    // ambient and diffuse, as for blocks (it's too far away for specular to matter):
+    vec3 ambientLight = ambientIntensity * lightColour * surfaceColour;
+    vec3 norm = normalize(normal);
+    vec3 lightDir = normalize(-lightDirection);
+    float diffuseCoefficient = max(dot(norm, lightDir), 0.0);
+    vec3 diffuseLight = diffuseIntensity * lightColour * diffuseCoefficient * surfaceColour;
+
+    float fog = smoothstep(fogStart, fogEnd, length(fragmentPosition.xz - viewPosition.xz));
+    colour = vec4(mix(ambientLight + diffuseLight, fogColour, fog), 1.0);
+
+}
@@ -0,0 +1,55 @@
+#version 330 core
+
+// NB: must match the block in shader-block.vs
+layout (std140) uniform Matrices {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+// the far terrain has its own depth range (see FarTerrain::render), so it has its own
+// projection matrix:
+uniform mat4 farProjection;
+
+// the heightmap holds (height, surface type) per sample, and wraps round (see FarTerrain):
+uniform sampler2D heightmap;
+uniform int gridSize;
+// the world position of the first sample in the grid, in samples:
+uniform ivec2 firstSample;
+uniform float spacing;
+
+out vec3 normal;
+out vec3 fragmentPosition;
+out vec3 surfaceColour;
+
+// NB: these match WorldGen's SURFACE_ values:
+const vec3 SURFACE_COLOURS[3] = vec3[3](
+    vec3(0.36, 0.55, 0.22), // grass
+    vec3(0.50, 0.49, 0.47), // rock
+    vec3(0.22, 0.38, 0.62)  // water
+);
+
+vec2 fetchSample(ivec2 sampleCoords) {
+    // x runs down the rows, and z across them:
+    ivec2 texel = sampleCoords & (gridSize - 1);
+    return texelFetch(heightmap, ivec2(texel.y, texel.x), 0).rg;
+}
+
+void main() {
+
+    // the grid's vertices are only ever given by index:
+    ivec2 sampleCoords = firstSample + ivec2(gl_VertexID / gridSize, gl_VertexID % gridSize);
+    vec2 surface = fetchSample(sampleCoords);
+
+    // the normal, from the slope between the neighbouring samples:
+    float dx = fetchSample(sampleCoords + ivec2(1, 0)).r - fetchSample(sampleCoords - ivec2(1, 0)).r;
+    float dz = fetchSample(sampleCoords + ivec2(0, 1)).r - fetchSample(sampleCoords - ivec2(0, 1)).r;
+    normal = vec3(-dx, 2.0 * spacing, -dz);
+
+    vec4 worldPosition = vec4(vec2(sampleCoords).x * spacing, surface.r, vec2(sampleCoords).y * spacing, 1.0);
+    fragmentPosition = worldPosition.xyz;
+    surfaceColour = SURFACE_COLOURS[int(surface.g)];
+
+    gl_Position = farProjection * view * worldPosition;
+
+}
@@ -11,43 +11,81 @@
 #include "./libs/window.h"
 #include "./libs/camera.h"
 #include "./libs/shader.h"
+#include "./libs/uniform-buffer.h"
 #include "./libs/texture-atlas.h"
 #include "./libs/read-file.h"
 #include "./helpers/timer.h"
 #include "./helpers/frame-counter.h"
+#include "./helpers/pool-stats-log.h"
 #include "./core/world.h"
+#include "./core/far-terrain.h"
+
+// these match the std140 layouts of the uniform blocks in the block shaders:
+struct MatricesBlock {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPosition;
+    float padding;
+};
+
+struct LightingBlock {
+    glm::vec3 lightDirection;
+    float ambientIntensity;
+    glm::vec3 lightColour;
+    float diffuseIntensity;
+    float specularIntensity;
+    float shininess;
+    float padding[2];
+};
 
 int main() {
     
     Window window("Voxy Lady", 800, 600);
     window.setSwapInterval(0);
 
-    Camera camera(glm::vec3(0, 250, 0), M_PI/2, 0, 10.0f, 0.01f, M_PI/4, window.getAspectRatio(), 0.1f, 250.0f);
-
-    // create uniform buffer object for projection and view matrices:
-    GLuint uboMatrices;
-    GLuint bindingPoint = 0;
-    glGenBuffers(1, &uboMatrices);
-    glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-    // allocation enough memory for the two matrices:
-    glBufferData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
-    // load data into buffer:
-    glm::mat4 projection = camera.calcualateProjectionMatrix();
-    glm::mat4 view = camera.calcualateViewMatrix();
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(projection));
-    glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(view));
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-    // finally, bind buffer to GL_UNIFORM_BUFFER binding point:
-    glBindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, uboMatrices, 0, 2 * sizeof(glm::mat4));
+    // NB: the far plane needs to take in the corners of the area covered by chunks, as
+    // the far terrain only starts beyond World::DRAW_DISTANCE:
+    Camera camera(glm::vec3(0, 250, 0), M_PI/2, 0, 10.0f, 0.01f, M_PI/4, window.getAspectRatio(), 0.1f, 2.0f * World::DRAW_DISTANCE);
+
+    // uniform buffers for the camera, and for lighting (see shader-block.fs):
+    UniformBuffer<MatricesBlock> matrices(0);
+    UniformBuffer<LightingBlock> lighting(1);
 
     Shader blockShader(readFile("./shaders/shader-block.vs"), readFile("./shaders/shader-block.fs"));
     blockShader.useShader();
-    blockShader.setUniformBufferBindingPoint("Matrices", bindingPoint);
+    blockShader.setUniformBufferBindingPoint("Matrices", matrices.getBindingPoint());
+    blockShader.setUniformBufferBindingPoint("Lighting", lighting.getBindingPoint());
+    // the texture atlas always goes in texture unit 0:
+    blockShader.setUniform(blockShader.getUniform<int>("diffuseTexture"), 0);
+    // and the chunks' faces in World::FACES_TEXTURE_UNIT:
+    blockShader.setUniform(blockShader.getUniform<int>("faces"), World::FACES_TEXTURE_UNIT);
+
+    Shader farTerrainShader(readFile("./shaders/shader-far-terrain.vs"), readFile("./shaders/shader-far-terrain.fs"));
+    farTerrainShader.useShader();
+    farTerrainShader.setUniformBufferBindingPoint("Matrices", matrices.getBindingPoint());
+    farTerrainShader.setUniformBufferBindingPoint("Lighting", lighting.getBindingPoint());
+
+    const glm::vec3 skyColour(0.55f, 0.75f, 1.0f);
+
+    LightingBlock lightingValues{};
+    lightingValues.lightDirection = glm::vec3(-2.0f, -4.0f, 1.0f);
+    lightingValues.lightColour = glm::vec3(1.0f, 1.0f, 1.0f);
+    lightingValues.ambientIntensity = 0.4f;
+    lightingValues.diffuseIntensity = 0.8f;
+    lightingValues.specularIntensity = 0.9f;
+    lightingValues.shininess = 128.0f;
+    lighting.set(lightingValues);
+
+    MatricesBlock matricesValues{};
+    matricesValues.projection = camera.calcualateProjectionMatrix();
 
     TextureAtlas blockTexture("./textures/atlas.png", 16, 16, true);
 
     World* world = new World();
 
+    // the far terrain takes over where the chunks stop, and fades into the sky:
+    FarTerrain* farTerrain = new FarTerrain(world->getWorldGen(), world->getExecutors(), world->getGLQueue(), farTerrainShader, World::DRAW_DISTANCE, skyColour);
+
     {
         Timer timer{};
 
@@ -64,6 +102,13 @@ int main() {
 
     FrameCounter frameCounter{};
 
+    // O toggles GPU occlusion queries:
+    bool wasOcclusionKeyDown = false;
+
+#ifdef THREAD_POOL_STATS
+    PoolStatsLog poolStatsLog("./build/pool-stats.csv", Executors::getNames(), world->getExecutors().getStats());
+#endif
+
     // render loop
     while (!window.shouldWindowClose()) {
 
@@ -76,40 +121,47 @@ int main() {
         camera.update(deltaTime, window);
         lastUpdateTime = now;
 
+#ifdef THREAD_POOL_STATS
+        // deltaTime covers the frame that's just finished, so this is the moment to
+        // snapshot the pools for it:
+        poolStatsLog.frame(deltaTime, world->getExecutors().getStats());
+#endif
+
+        bool isOcclusionKeyDown = window.getKeyStates()[GLFW_KEY_O];
+        if (isOcclusionKeyDown && !wasOcclusionKeyDown) {
+            world->setOcclusionQueries(!world->getOcclusionQueries());
+        }
+        wasOcclusionKeyDown = isOcclusionKeyDown;
+
         {
 
             Timer timer{};
 
             world->update(camera.getPosition());
+            farTerrain->update(camera.getPosition());
 
             timer.printTime("world update");
             
         }
 
         // render
-        glClearColor(0.55f, 0.75f, 1.0f, 1.0f);
+        glClearColor(skyColour.x, skyColour.y, skyColour.z, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         
-        glm::vec3 lightDirection(-2.0f, -4.0f, 1.0f);
-        glm::vec3 lightColour(1.0f, 1.0f, 1.0f);
+        // update the camera's uniform buffer (lighting only changes when set):
+        matricesValues.view = camera.calcualateViewMatrix();
+        matricesValues.viewPosition = camera.getPosition();
+        matrices.set(matricesValues);
 
-        // update view in uniform buffer block:
-        glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-        glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(camera.calcualateViewMatrix()));
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        // the far terrain goes behind everything else, with its own depth range (so
+        // the depth buffer's cleared again afterwards):
+        farTerrain->render(camera);
+        glClear(GL_DEPTH_BUFFER_BIT);
 
         // draw blocks:
         blockShader.useShader();
         blockTexture.useTextureAtlas(GL_TEXTURE0);
-        blockShader.setUniformInt("material.diffuseTexture", 0);
-        blockShader.setUniformInt("material.shininess", 128);
-        blockShader.setUniformVec3("light.direction", lightDirection);
-        blockShader.setUniformVec3("light.colour",  lightColour);
-        blockShader.setUniformFloat("light.ambientIntensity", 0.4f);
-        blockShader.setUniformFloat("light.diffuseIntensity", 0.8f);
-        blockShader.setUniformFloat("light.specularIntensity", 0.9f);
-        blockShader.setUniformVec3("viewPosition", camera.getPosition());
-        world->render(camera, blockShader);
+        world->render(camera);
 
         window.swapBuffers();
 
@@ -117,6 +169,7 @@ int main() {
 
     }
 
+    delete farTerrain;
     delete world;
 
     std::cout << "overall fps: " << frameCounter.getTotalFPS() << std::endl;